@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../lib/libsmalljson.pdb"
+  "../lib/libsmalljson.so"
+  "CMakeFiles/smalljson.dir/smalljson.cc.o"
+  "CMakeFiles/smalljson.dir/smalljson.cc.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/smalljson.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
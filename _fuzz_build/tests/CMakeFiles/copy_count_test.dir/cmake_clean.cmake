@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../bin/copy_count_test"
+  "../bin/copy_count_test.pdb"
+  "CMakeFiles/copy_count_test.dir/copy_count_test.cc.o"
+  "CMakeFiles/copy_count_test.dir/copy_count_test.cc.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/copy_count_test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
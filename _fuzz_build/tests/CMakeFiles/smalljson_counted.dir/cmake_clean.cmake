@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../lib/libsmalljson_counted.a"
+  "../lib/libsmalljson_counted.pdb"
+  "CMakeFiles/smalljson_counted.dir/__/smalljson/smalljson.cc.o"
+  "CMakeFiles/smalljson_counted.dir/__/smalljson/smalljson.cc.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/smalljson_counted.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
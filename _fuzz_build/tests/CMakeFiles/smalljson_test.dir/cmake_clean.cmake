@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "../bin/smalljson_test"
+  "../bin/smalljson_test.pdb"
+  "CMakeFiles/smalljson_test.dir/smalljson_test.cc.o"
+  "CMakeFiles/smalljson_test.dir/smalljson_test.cc.o.d"
+  "smalljson_gen/message_parser.h"
+  "smalljson_gen/odd_keys_parser.h"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/smalljson_test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,65 @@
+// Generated by smalljson_codegen from /root/repo/tests/message.schema.json. Do not edit.
+#pragma once
+
+#include "smalljson.h"
+
+struct Message {
+  int64_t id = 0;
+  std::string name;
+  double score = 0;
+  smalljson::Value tags;
+  smalljson::Object extra;
+
+  static Message parse(const std::string &json_data);
+};
+
+inline Message Message::parse(const std::string &json_data) {
+  using smalljson::Exception;
+  static constexpr uint32_t kSeed = 84696352u;
+  static constexpr struct {
+    std::string_view key;
+    int field;
+  } kSlots[8] = {
+      {{}, -1},
+      {"tags", 3},
+      {"score", 2},
+      {"name", 1},
+      {{}, -1},
+      {"id", 0},
+      {{}, -1},
+      {{}, -1},
+  };
+  Message out;
+  smalljson::Cursor cur(json_data);
+  cur.expect('{', Exception::ParseError::NOT_JSON);
+  if (!cur.consume('}')) {
+    do {
+      std::string_view key = cur.read_key();
+      std::string unescaped;
+      if (key.find('\\') != std::string_view::npos)
+        key = unescaped = cur.unescape(key);
+      cur.expect(':', Exception::ParseError::MISS_COLON);
+      const auto &slot = kSlots[smalljson::hashKey(key, kSeed) & 7];
+      switch (slot.key == key ? slot.field : -1) {
+      case 0:
+        out.id = cur.read_int64();
+        break;
+      case 1:
+        out.name = cur.read_string();
+        break;
+      case 2:
+        out.score = cur.read_double();
+        break;
+      case 3:
+        out.tags = cur.read_value();
+        break;
+      default:
+        out.extra[std::string(key)] = cur.read_value();
+        break;
+      }
+    } while (cur.consume(','));
+    cur.expect('}', Exception::ParseError::LACK_COMMA_OR_BRACE);
+  }
+  cur.finish();
+  return out;
+}
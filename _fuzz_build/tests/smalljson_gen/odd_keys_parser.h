@@ -0,0 +1,121 @@
+// Generated by smalljson_codegen from /root/repo/tests/odd_keys.schema.json. Do not edit.
+#pragma once
+
+#include "smalljson.h"
+
+struct OddKeys {
+  int64_t OddKeys_2 = 0;
+  int64_t a_b = 0;
+  int64_t a_b_2 = 0;
+  int64_t bell_ = 0;
+  int64_t del_9 = 0;
+  int64_t extra_ = 0;
+  int64_t extra__2 = 0;
+  int64_t line_break = 0;
+  int64_t nul_ = 0;
+  int64_t parse_ = 0;
+  int64_t quote_back_ = 0;
+  int64_t tab_here = 0;
+  smalljson::Object extra;
+
+  static OddKeys parse(const std::string &json_data);
+};
+
+inline OddKeys OddKeys::parse(const std::string &json_data) {
+  using smalljson::Exception;
+  static constexpr uint32_t kSeed = 1907585972u;
+  static constexpr struct {
+    std::string_view key;
+    int field;
+  } kSlots[32] = {
+      {{}, -1},
+      {"OddKeys", 0},
+      {{}, -1},
+      {"line\nbreak", 7},
+      {{}, -1},
+      {{}, -1},
+      {"bell\007", 3},
+      {{}, -1},
+      {{}, -1},
+      {{}, -1},
+      {{}, -1},
+      {{}, -1},
+      {"a-b", 1},
+      {{}, -1},
+      {{}, -1},
+      {{}, -1},
+      {"tab\there", 11},
+      {"del\1779", 4},
+      {"extra", 5},
+      {"parse", 9},
+      {{}, -1},
+      {std::string_view("nul\000", 4), 8},
+      {"a_b", 2},
+      {"extra_", 6},
+      {{}, -1},
+      {{}, -1},
+      {{}, -1},
+      {"quote\"back\\", 10},
+      {{}, -1},
+      {{}, -1},
+      {{}, -1},
+      {{}, -1},
+  };
+  OddKeys out;
+  smalljson::Cursor cur(json_data);
+  cur.expect('{', Exception::ParseError::NOT_JSON);
+  if (!cur.consume('}')) {
+    do {
+      std::string_view key = cur.read_key();
+      std::string unescaped;
+      if (key.find('\\') != std::string_view::npos)
+        key = unescaped = cur.unescape(key);
+      cur.expect(':', Exception::ParseError::MISS_COLON);
+      const auto &slot = kSlots[smalljson::hashKey(key, kSeed) & 31];
+      switch (slot.key == key ? slot.field : -1) {
+      case 0:
+        out.OddKeys_2 = cur.read_int64();
+        break;
+      case 1:
+        out.a_b = cur.read_int64();
+        break;
+      case 2:
+        out.a_b_2 = cur.read_int64();
+        break;
+      case 3:
+        out.bell_ = cur.read_int64();
+        break;
+      case 4:
+        out.del_9 = cur.read_int64();
+        break;
+      case 5:
+        out.extra_ = cur.read_int64();
+        break;
+      case 6:
+        out.extra__2 = cur.read_int64();
+        break;
+      case 7:
+        out.line_break = cur.read_int64();
+        break;
+      case 8:
+        out.nul_ = cur.read_int64();
+        break;
+      case 9:
+        out.parse_ = cur.read_int64();
+        break;
+      case 10:
+        out.quote_back_ = cur.read_int64();
+        break;
+      case 11:
+        out.tab_here = cur.read_int64();
+        break;
+      default:
+        out.extra[std::string(key)] = cur.read_value();
+        break;
+      }
+    } while (cur.consume(','));
+    cur.expect('}', Exception::ParseError::LACK_COMMA_OR_BRACE);
+  }
+  cur.finish();
+  return out;
+}
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../bin/smalljson_codegen"
+  "../bin/smalljson_codegen.pdb"
+  "CMakeFiles/smalljson_codegen.dir/smalljson_codegen.cc.o"
+  "CMakeFiles/smalljson_codegen.dir/smalljson_codegen.cc.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/smalljson_codegen.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../bin/smalljson_fuzz"
+  "../bin/smalljson_fuzz.pdb"
+  "CMakeFiles/smalljson_fuzz.dir/smalljson_fuzz.cc.o"
+  "CMakeFiles/smalljson_fuzz.dir/smalljson_fuzz.cc.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/smalljson_fuzz.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,27 @@
+# smalljson_generate_parsers(<target> SCHEMAS <schema.json>... [NAMESPACE <ns>])
+#
+# Runs smalljson_codegen on each schema and adds the generated
+# <name>_parser.h headers to <target>, where <name> is the schema file name
+# up to its first dot.
+function(smalljson_generate_parsers target)
+    cmake_parse_arguments(ARG "" "NAMESPACE" "SCHEMAS" ${ARGN})
+    set(gen_dir ${CMAKE_CURRENT_BINARY_DIR}/smalljson_gen)
+    set(outputs)
+    foreach(schema ${ARG_SCHEMAS})
+        get_filename_component(schema_path ${schema} ABSOLUTE)
+        get_filename_component(name ${schema} NAME_WE)
+        set(output ${gen_dir}/${name}_parser.h)
+        add_custom_command(
+            OUTPUT ${output}
+            COMMAND ${CMAKE_COMMAND} -E make_directory ${gen_dir}
+            COMMAND smalljson_codegen ${schema_path} ${output} ${ARG_NAMESPACE}
+            DEPENDS smalljson_codegen ${schema_path}
+            COMMENT "Generating smalljson parser for ${schema}"
+            VERBATIM
+            )
+        list(APPEND outputs ${output})
+    endforeach()
+    target_sources(${target} PRIVATE ${outputs})
+    target_include_directories(${target} PRIVATE ${gen_dir})
+    target_link_libraries(${target} PRIVATE smalljson)
+endfunction()
@@ -1,11 +1,415 @@
 #include "smalljson.h"
+#include <algorithm>
 #include <cassert>
+#include <charconv>
+#include <climits>
+#include <cstring>
 #include <iostream>
+#include <mutex>
+#include <system_error>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 namespace smalljson {
-std::string escapeJson(const std::string &str);
+void appendQuoted(std::string &out, const String &str);
 
-std::string unescapeJson(const std::string &str);
+void appendNumber(std::string &out, const Value::value_t &num);
+
+uint8_t classifyString(const char *str, size_t len);
+
+#ifdef SMALLJSON_COUNT_COPIES
+static std::atomic<uint64_t> deep_copies{0};
+#endif
+
+static void countCopy() {
+#ifdef SMALLJSON_COUNT_COPIES
+  deep_copies.fetch_add(1, std::memory_order_relaxed);
+#endif
+}
+
+uint64_t deep_copy_count() noexcept {
+#ifdef SMALLJSON_COUNT_COPIES
+  return deep_copies.load(std::memory_order_relaxed);
+#else
+  return 0;
+#endif
+}
+
+static constexpr size_t kHugePageSize = size_t(2) << 20;
+
+// One bit per 2 MiB page of the address space, set while an Arena chunk
+// covers it, so deallocate() can tell arena memory from the heap without
+// a lock whichever thread frees it. Chunks are 2 MiB aligned, so a page
+// is never shared with the heap. Leaves are allocated on first use and
+// never freed; only mapChunk() and ~Arena() write, under arena_mutex.
+static constexpr unsigned kPageShift = 21;
+static constexpr unsigned kAddressBits = 48;
+static constexpr size_t kLeafPages = size_t(1) << 14;
+static constexpr size_t kLeaves =
+    (size_t(1) << (kAddressBits - kPageShift)) / kLeafPages;
+struct PageLeaf {
+  std::atomic<uint64_t> words[kLeafPages / 64];
+};
+static std::atomic<PageLeaf *> arena_pages[kLeaves];
+static std::mutex arena_mutex;
+static std::atomic<size_t> arena_chunks{0};
+static thread_local Arena *current_arena = nullptr;
+
+static bool arenaOwned(const void *ptr) noexcept {
+  if (arena_chunks.load(std::memory_order_relaxed) == 0)
+    return false;
+  uintptr_t page = reinterpret_cast<uintptr_t>(ptr) >> kPageShift;
+  if (page / kLeafPages >= kLeaves)
+    return false;
+  PageLeaf *leaf =
+      arena_pages[page / kLeafPages].load(std::memory_order_acquire);
+  if (!leaf)
+    return false;
+  uint64_t word =
+      leaf->words[page % kLeafPages / 64].load(std::memory_order_relaxed);
+  return (word >> (page % 64)) & 1;
+}
+
+// Sets or clears the bits of [base, base + size). Returns false, changing
+// nothing, when the range is beyond the addresses the bitmap covers.
+static bool markArenaPages(const char *base, size_t size, bool live) {
+  uintptr_t first = reinterpret_cast<uintptr_t>(base) >> kPageShift;
+  uintptr_t last = first + (size >> kPageShift);
+  if (last > kLeaves * kLeafPages)
+    return false;
+  std::lock_guard<std::mutex> lock(arena_mutex);
+  for (uintptr_t page = first; page < last; page++) {
+    std::atomic<PageLeaf *> &slot = arena_pages[page / kLeafPages];
+    PageLeaf *leaf = slot.load(std::memory_order_relaxed);
+    if (!leaf) {
+      leaf = new PageLeaf();
+      slot.store(leaf, std::memory_order_release);
+    }
+    uint64_t bit = uint64_t(1) << (page % 64);
+    std::atomic<uint64_t> &word = leaf->words[page % kLeafPages / 64];
+    if (live)
+      word.fetch_or(bit, std::memory_order_relaxed);
+    else
+      word.fetch_and(~bit, std::memory_order_relaxed);
+  }
+  return true;
+}
+
+// Prefer the node the calling thread runs on. MPOL_PREFERRED rather than
+// MPOL_BIND, so a full node spills over instead of failing. Done with the
+// raw syscall, so libnuma is not needed.
+static void bindToLocalNode(void *addr, size_t size) {
+#if defined(__linux__) && defined(SYS_mbind) && defined(SYS_getcpu)
+  constexpr int kMpolPreferred = 1;
+  unsigned cpu = 0, node = 0;
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0 ||
+      node >= sizeof(unsigned long) * CHAR_BIT)
+    return;
+  unsigned long mask = 1UL << node;
+  syscall(SYS_mbind, addr, size, kMpolPreferred, &mask,
+          sizeof(mask) * CHAR_BIT + 1, 0);
+#else
+  (void)addr;
+  (void)size;
+#endif
+}
+
+Arena::Arena(const Options &options) : options_(options) {
+  options_.chunk_size =
+      std::max(kHugePageSize, (options_.chunk_size + kHugePageSize - 1) &
+                                  ~(kHugePageSize - 1));
+}
+
+Arena::~Arena() {
+  if (chunks_.empty())
+    return;
+  for (auto &chunk : chunks_) {
+    markArenaPages(chunk.base, chunk.size, false);
+#ifdef __linux__
+    munmap(chunk.base, chunk.size);
+#else
+    ::operator delete(chunk.base, std::align_val_t(kHugePageSize));
+#endif
+  }
+  arena_chunks.fetch_sub(chunks_.size(), std::memory_order_relaxed);
+}
+
+char *Arena::mapChunk(size_t size) {
+  size = (size + kHugePageSize - 1) & ~(kHugePageSize - 1);
+  char *base = nullptr;
+#ifdef __linux__
+  void *ptr = MAP_FAILED;
+  if (options_.hugetlb)
+    ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (ptr == MAP_FAILED) {
+    // Over-map by a huge page and trim, so the chunk starts on a huge page
+    // boundary where the kernel can back it with huge pages.
+    size_t mapped = size + kHugePageSize;
+    ptr = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+      throw std::bad_alloc();
+    uintptr_t start = reinterpret_cast<uintptr_t>(ptr);
+    uintptr_t aligned = (start + kHugePageSize - 1) & ~(kHugePageSize - 1);
+    if (aligned != start)
+      munmap(ptr, aligned - start);
+    if (aligned + size != start + mapped)
+      munmap(reinterpret_cast<void *>(aligned + size),
+             start + mapped - aligned - size);
+    ptr = reinterpret_cast<void *>(aligned);
+#ifdef MADV_HUGEPAGE
+    if (options_.transparent_huge_pages)
+      madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+  }
+  base = static_cast<char *>(ptr);
+  if (options_.numa_local)
+    bindToLocalNode(base, size);
+#else
+  base = static_cast<char *>(
+      ::operator new(size, std::align_val_t(kHugePageSize)));
+#endif
+  if (!markArenaPages(base, size, true)) {
+#ifdef __linux__
+    munmap(base, size);
+#else
+    ::operator delete(base, std::align_val_t(kHugePageSize));
+#endif
+    throw std::bad_alloc();
+  }
+  chunks_.push_back(Chunk{base, size});
+  capacity_ += size;
+  arena_chunks.fetch_add(1, std::memory_order_relaxed);
+  return base;
+}
+
+void *Arena::allocate(size_t size, size_t align) {
+  used_ += size;
+  // Large blocks get a chunk of their own and leave the current one be.
+  if (size > options_.chunk_size / 4)
+    return mapChunk(size);
+  uintptr_t addr = reinterpret_cast<uintptr_t>(cur_);
+  uintptr_t aligned = (addr + align - 1) & ~(uintptr_t(align) - 1);
+  if (!cur_ || aligned + size > reinterpret_cast<uintptr_t>(end_)) {
+    cur_ = mapChunk(options_.chunk_size);
+    end_ = cur_ + options_.chunk_size;
+    aligned = reinterpret_cast<uintptr_t>(cur_);
+  }
+  cur_ = reinterpret_cast<char *>(aligned + size);
+  return reinterpret_cast<void *>(aligned);
+}
+
+bool Arena::owns(const void *ptr) const noexcept {
+  for (auto &chunk : chunks_) {
+    if (ptr >= chunk.base && ptr < chunk.base + chunk.size)
+      return true;
+  }
+  return false;
+}
+
+ArenaScope::ArenaScope(Arena &arena) noexcept : previous_(current_arena) {
+  current_arena = &arena;
+}
+
+ArenaScope::~ArenaScope() { current_arena = previous_; }
+
+void *detail::allocate(size_t size) {
+  return current_arena ? current_arena->allocate(size) : ::operator new(size);
+}
+
+void detail::deallocate(void *ptr, size_t size) noexcept {
+  if (!arenaOwned(ptr))
+    ::operator delete(ptr, size);
+}
+
+template class BasicParser<ParseOptions>;
+template class BasicParser<RelaxedParseOptions>;
+
+namespace {
+// The configurations reachable through the runtime arguments of
+// Parser::parse and Document::parse.
+template <NumberMode Mode, DuplicateKeys Keys = DuplicateKeys::LastWins,
+          bool ZeroCopy = false>
+struct RuntimeOptions : ParseOptions {
+  static constexpr NumberMode number_mode = Mode;
+  static constexpr DuplicateKeys duplicate_keys = Keys;
+  static constexpr bool zero_copy = ZeroCopy;
+};
+
+template <NumberMode Mode>
+Value parseWith(const std::string &json_data, DuplicateKeys keys) {
+  switch (keys) {
+  case DuplicateKeys::FirstWins:
+    return BasicParser<RuntimeOptions<Mode, DuplicateKeys::FirstWins>>::parse(
+        json_data);
+  case DuplicateKeys::Reject:
+    return BasicParser<RuntimeOptions<Mode, DuplicateKeys::Reject>>::parse(
+        json_data);
+  default:
+    if constexpr (Mode == NumberMode::Binary)
+      return BasicParser<>::parse(json_data);
+    else
+      return BasicParser<RuntimeOptions<Mode>>::parse(json_data);
+  }
+}
+
+#ifdef SMALLJSON_PREFETCH
+void prefetch(const void *ptr) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(ptr);
+#else
+  (void)ptr;
+#endif
+}
+
+// A value's out-of-line data is reached in two hops: the child Object or
+// Array (or the bytes of a long string), then the first map node or the
+// element storage of that child.
+void prefetchPayload(const Value &value) noexcept {
+  if (auto obj = value.get_if<Object>())
+    prefetch(obj);
+  else if (auto arr = value.get_if<Array>())
+    prefetch(arr);
+  else if (auto str = value.get_if<String>())
+    prefetch(str->data());
+}
+
+void prefetchChildren(const Value &value) noexcept {
+  if (auto obj = value.get_if<Object>()) {
+    if (!obj->empty())
+      prefetch(&*obj->begin());
+  } else if (auto arr = value.get_if<Array>()) {
+    if (!arr->empty())
+      prefetch(&*arr->begin());
+  }
+}
+
+void prefetchPayload(const Object::object_t::value_type &entry) noexcept {
+  prefetch(entry.first.data());
+  prefetchPayload(entry.second);
+}
+
+void prefetchChildren(const Object::object_t::value_type &entry) noexcept {
+  prefetchChildren(entry.second);
+}
+
+// Iterates [first, last) for the recursive walks (to_print, hash,
+// equality, memory_usage). In a tree built piecemeal, map nodes, child
+// containers and strings are scattered over the heap and every hop is a
+// cache miss, so each hop is requested an entry before it is needed: the
+// map node three entries ahead, the payload of the entry two ahead and the
+// first child of the next one. Off by default: a tree the parser built was
+// allocated in walk order, the hardware prefetcher already follows it, and
+// the extra iterator steps cost a few percent there.
+template <typename Iter> class Lookahead {
+public:
+  Lookahead(Iter first, Iter last) : cur_(first), last_(last) {
+    for (Iter &ahead : ahead_) {
+      if (first != last_)
+        ++first;
+      ahead = first;
+    }
+    issue();
+  }
+  bool done() const noexcept { return cur_ == last_; }
+  decltype(auto) operator*() const noexcept { return *cur_; }
+  void advance() noexcept {
+    cur_ = ahead_[0];
+    ahead_[0] = ahead_[1];
+    ahead_[1] = ahead_[2];
+    if (ahead_[2] != last_)
+      ++ahead_[2];
+    issue();
+  }
+
+private:
+  static constexpr size_t kDistance = 3;
+
+  void issue() const noexcept {
+    if (ahead_[2] != last_)
+      prefetch(&*ahead_[2]);
+    if (ahead_[1] != last_)
+      prefetchPayload(*ahead_[1]);
+    if (ahead_[0] != last_)
+      prefetchChildren(*ahead_[0]);
+  }
+
+  Iter cur_;
+  Iter ahead_[kDistance];
+  Iter last_;
+};
+#else
+template <typename Iter> class Lookahead {
+public:
+  Lookahead(Iter first, Iter last) : cur_(first), last_(last) {}
+  bool done() const noexcept { return cur_ == last_; }
+  decltype(auto) operator*() const noexcept { return *cur_; }
+  void advance() noexcept { ++cur_; }
+
+private:
+  Iter cur_, last_;
+};
+#endif
+
+template <typename Container>
+Lookahead<typename Container::const_iterator>
+lookahead(const Container &items) {
+  return {items.begin(), items.end()};
+}
+
+size_t heapBytes(const String &str) noexcept {
+  return str.size() > String::kInlineCapacity ? str.size() : 0;
+}
+
+size_t hashCombine(size_t seed, size_t value) noexcept {
+  return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+}
+} // namespace
+
+String::String(const char *str, size_t len) {
+  assign(str, len, classifyString(str, len));
+}
+
+String::String(const String &rhs) { assign(rhs.data(), rhs.size(), rhs.flags()); }
+
+String &String::operator=(const String &rhs) {
+  if (this != &rhs) {
+    String tmp(rhs);
+    *this = std::move(tmp);
+  }
+  return *this;
+}
+
+String &String::operator=(String &&rhs) noexcept {
+  if (this != &rhs) {
+    if (isHeap())
+      detail::deallocate(heapPtr(), heapSize());
+    std::memcpy(bytes_, rhs.bytes_, sizeof(bytes_));
+    rhs.setInline(0, ValidUtf8);
+  }
+  return *this;
+}
+
+void String::assign(const char *str, size_t len, uint8_t flags) {
+  if (len <= kInlineCapacity) {
+    std::memcpy(bytes_, str, len);
+    setInline(len, flags);
+    return;
+  }
+  char *ptr = static_cast<char *>(detail::allocate(len));
+  std::memcpy(ptr, str, len);
+  std::memcpy(bytes_, &ptr, sizeof(ptr));
+  std::memcpy(bytes_ + sizeof(ptr), &len, sizeof(len));
+  bytes_[kFlags] = static_cast<char>(flags);
+  bytes_[kTag] = static_cast<char>(kHeapTag);
+}
 
 Value::Value(const Array &arr)
     : type_(ValueType::Array), value_data_(std::make_unique<Array>(arr)) {}
@@ -28,8 +432,20 @@ Value &Value::operator=(const Value &rhs) {
 }
 
 void Value::deepCopy(const Value::value_t &rhs) {
-  if (auto pval = std::get_if<std::string>(&rhs)) {
+  if (auto pval = std::get_if<String>(&rhs)) {
+    value_data_ = *pval;
+  } else if (auto pval = std::get_if<int64_t>(&rhs)) {
     value_data_ = *pval;
+  } else if (auto pval = std::get_if<double>(&rhs)) {
+    value_data_ = *pval;
+  } else if (auto pval = std::get_if<Number>(&rhs)) {
+    if (pval->exact() && pval->kind() == Number::Integer) {
+      value_data_ = *pval->to_int64();
+    } else if (pval->exact()) {
+      value_data_ = pval->to_double();
+    } else {
+      value_data_ = String(pval->text());
+    }
   } else if (auto pval = std::get_if<object_ptr>(&rhs)) {
     value_data_ = std::make_unique<Object>(**pval);
   } else if (auto pval = std::get_if<array_ptr>(&rhs)) {
@@ -38,20 +454,22 @@ void Value::deepCopy(const Value::value_t &rhs) {
 }
 
 const std::string Value::to_raw_string() const {
-  return std::get<std::string>(value_data_);
+  return std::get<String>(value_data_).str();
 }
 
 std::string Value::to_raw_string() {
-  return std::get<std::string>(value_data_);
+  return std::get<String>(value_data_).str();
 }
 
 Value &Value::operator[](size_t idx) { return to_array()[idx]; }
 
 Value &Value::operator[](const std::string &key) { return to_object()[key]; }
 
+Value &Value::operator[](const Key &key) { return to_object()[key]; }
+
 bool Value::to_boolean() const {
   if (isBoolean()) {
-    const std::string &b_str = to_raw_string();
+    const String &b_str = std::get<String>(value_data_);
     if (b_str == "true") {
       return true;
     } else if (b_str == "false") {
@@ -64,47 +482,153 @@ bool Value::to_boolean() const {
 }
 
 int Value::to_integer() const {
-  if (isNumber()) {
-    return std::stoi(to_raw_string());
+  if (!isNumber()) {
+    throw Exception(Exception::ParseError::BAD_TYPE);
   }
-  throw Exception(Exception::ParseError::BAD_TYPE);
-}
-
-float Value::to_float() const {
-  if (isNumber()) {
-    return std::stof(to_raw_string());
+  if (auto num = get<int>()) {
+    return *num;
   }
-  throw Exception(Exception::ParseError::BAD_TYPE);
+  double num = to_double();
+  if (!(num > INT_MIN - 1.0 && num < INT_MAX + 1.0))
+    throw std::out_of_range("smalljson::Value::to_integer");
+  return static_cast<int>(num);
 }
 
+float Value::to_float() const { return static_cast<float>(to_double()); }
+
 double Value::to_double() const {
+  if (auto pval = std::get_if<double>(&value_data_)) {
+    return *pval;
+  }
+  if (auto pval = std::get_if<int64_t>(&value_data_)) {
+    return static_cast<double>(*pval);
+  }
+  if (auto pval = std::get_if<Number>(&value_data_)) {
+    return pval->to_double();
+  }
   if (isNumber()) {
-    return std::stof(to_raw_string());
+    const String &text = std::get<String>(value_data_);
+    return detail::decodeDouble(text.data(), text.data() + text.size());
   }
   throw Exception(Exception::ParseError::BAD_TYPE);
 }
 
 const std::string Value::to_print() const {
+  std::string out;
+  to_print(out);
+  return out;
+}
+
+void Value::to_print(std::string &out) const {
   switch (type_) {
   case ValueType::Null:
-    return "null";
+    out += "null";
+    break;
   case ValueType::Boolean:
+    out += std::get<String>(value_data_).view();
+    break;
   case ValueType::Number:
-    return std::get<std::string>(value_data_);
+    appendNumber(out, value_data_);
+    break;
   case ValueType::String:
-    return "\"" + std::get<std::string>(value_data_) + "\"";
+    appendQuoted(out, std::get<String>(value_data_));
+    break;
   case ValueType::Object:
-    return std::get<object_ptr>(value_data_)->to_print();
+    std::get<object_ptr>(value_data_)->to_print(out);
+    break;
   case ValueType::Array:
-    return std::get<array_ptr>(value_data_)->to_print();
+    std::get<array_ptr>(value_data_)->to_print(out);
+    break;
   default:
     throw Exception(Exception::ParseError::NOT_JSON);
   }
 }
 
+size_t Value::memory_usage() const noexcept {
+  if (auto pval = std::get_if<object_ptr>(&value_data_))
+    return *pval ? sizeof(Object) + (*pval)->memory_usage() : 0;
+  if (auto pval = std::get_if<array_ptr>(&value_data_))
+    return *pval ? sizeof(Array) + (*pval)->memory_usage() : 0;
+  if (auto pval = std::get_if<String>(&value_data_))
+    return heapBytes(*pval);
+  return 0;
+}
+
+size_t Value::hash() const noexcept {
+  size_t seed = static_cast<size_t>(type_);
+  switch (type_) {
+  case ValueType::Boolean:
+  case ValueType::String:
+    return hashCombine(seed, std::hash<std::string_view>()(
+                                 std::get<String>(value_data_).view()));
+  case ValueType::Number:
+    if (auto num = get<int64_t>())
+      return hashCombine(seed, std::hash<int64_t>()(*num));
+    return hashCombine(seed, std::hash<double>()(get<double>().value_or(0)));
+  case ValueType::Object:
+    for (auto it = lookahead(to_object()); !it.done(); it.advance()) {
+      seed = hashCombine(seed, std::hash<std::string_view>()((*it).first));
+      seed = hashCombine(seed, (*it).second.hash());
+    }
+    return seed;
+  case ValueType::Array:
+    for (auto it = lookahead(to_array()); !it.done(); it.advance())
+      seed = hashCombine(seed, (*it).hash());
+    return seed;
+  default:
+    return seed;
+  }
+}
+
+bool operator==(const Value &lhs, const Value &rhs) noexcept {
+  if (lhs.type_ != rhs.type_)
+    return false;
+  switch (lhs.type_) {
+  case Value::ValueType::Boolean:
+  case Value::ValueType::String:
+    return std::get<String>(lhs.value_data_) ==
+           std::get<String>(rhs.value_data_);
+  case Value::ValueType::Number: {
+    auto lnum = lhs.get<int64_t>();
+    auto rnum = rhs.get<int64_t>();
+    if (lnum || rnum)
+      return lnum == rnum;
+    return lhs.get<double>() == rhs.get<double>();
+  }
+  case Value::ValueType::Object: {
+    const Object &lobj = lhs.to_object();
+    const Object &robj = rhs.to_object();
+    if (lobj.size() != robj.size())
+      return false;
+    auto rit = lookahead(robj);
+    for (auto lit = lookahead(lobj); !lit.done();
+         lit.advance(), rit.advance()) {
+      if ((*lit).first != (*rit).first || (*lit).second != (*rit).second)
+        return false;
+    }
+    return true;
+  }
+  case Value::ValueType::Array: {
+    const Array &larr = lhs.to_array();
+    const Array &rarr = rhs.to_array();
+    if (larr.size() != rarr.size())
+      return false;
+    auto rit = lookahead(rarr);
+    for (auto lit = lookahead(larr); !lit.done();
+         lit.advance(), rit.advance()) {
+      if (*lit != *rit)
+        return false;
+    }
+    return true;
+  }
+  default:
+    return true;
+  }
+}
+
 const std::string Value::to_string() const {
   if (isString()) {
-    return unescapeJson(std::get<std::string>(value_data_));
+    return std::get<String>(value_data_).str();
   }
   throw Exception(Exception::ParseError::BAD_TYPE);
 }
@@ -153,338 +677,2007 @@ const Value &Value::at(const std::string &key) const {
   return to_object().at(key);
 }
 
+Value &Value::at(const Key &key) { return to_object().at(key); }
+
+const Value &Value::at(const Key &key) const { return to_object().at(key); }
+
+Object::Object(const Object &rhs)
+    : object_data_(rhs.object_data_), hash_index_(rhs.hash_index_) {
+  countCopy();
+  if (!rhs.ctrl_.empty())
+    buildIndex();
+}
+
+Object::Object(const object_t &object_data) : object_data_(object_data) {
+  countCopy();
+  ensureIndex();
+}
+
+Object::Object(object_t &&object_data, HashIndex hash_index)
+    : object_data_(std::move(object_data)), hash_index_(hash_index) {
+  ensureIndex();
+}
+
+Object::Object(std::initializer_list<object_t::value_type> init_list)
+    : object_data_(init_list) {
+  ensureIndex();
+}
+
+Object &Object::operator=(const Object &rhs) {
+  if (this != &rhs) {
+    countCopy();
+    object_data_ = rhs.object_data_;
+    hash_index_ = rhs.hash_index_;
+    dropIndex();
+    if (!rhs.ctrl_.empty())
+      buildIndex();
+  }
+  return *this;
+}
+
 const std::string Object::to_print() const {
-  std::string str = "{";
-  for (auto &[key, value] : object_data_) {
-    str += "\"" + escapeJson(key) + "\":" + value.to_print() + ",";
+  std::string out;
+  to_print(out);
+  return out;
+}
+
+void Object::to_print(std::string &out) const {
+  out += '{';
+  for (auto it = lookahead(object_data_); !it.done(); it.advance()) {
+    auto &[key, value] = *it;
+    appendQuoted(out, key);
+    out += ':';
+    value.to_print(out);
+    out += ',';
   }
-  if (*(str.end() - 1) == ',') {
-    str.pop_back();
+  if (out.back() == ',') {
+    out.back() = '}';
+  } else {
+    out += '}';
   }
-  str += "}";
-  return str;
 }
 
-Value &Object::operator[](const std::string &key) { return object_data_[key]; }
+size_t Object::memory_usage() const noexcept {
+  // Red-black tree nodes in libstdc++ and libc++: three links and a colour.
+  size_t node = sizeof(object_t::value_type) + 4 * sizeof(void *);
+  size_t bytes = object_data_.size() * node + ctrl_.capacity() +
+                 slots_.capacity() * sizeof(iterator);
+  for (auto it = lookahead(object_data_); !it.done(); it.advance())
+    bytes += heapBytes((*it).first) + (*it).second.memory_usage();
+  return bytes;
+}
 
-Value &Object::operator[](std::string &&key) {
-  return object_data_[std::move(key)];
+Object::object_t::mapped_type &Object::at(const std::string &key) {
+  auto iter = find(key);
+  if (iter == end())
+    throw std::out_of_range("smalljson::Object::at");
+  return iter->second;
 }
 
-const std::string Array::to_print() const {
-  std::string str = "[";
-  for (auto &value : array_data_) {
-    str += value.to_print() + ",";
-  }
-  if (*(str.end() - 1) == ',') {
-    str.pop_back();
-  }
-  str += "]";
-  return str;
+const Object::object_t::mapped_type &Object::at(const std::string &key) const {
+  auto iter = find(key);
+  if (iter == end())
+    throw std::out_of_range("smalljson::Object::at");
+  return iter->second;
 }
 
-Value &Array::operator[](size_t idx) { return array_data_[idx]; }
+Value &Object::operator[](const std::string &key) {
+  if (object_data_.size() >= indexThreshold())
+    return (*this)[Key(key)];
+  auto result = object_data_.try_emplace(key);
+  if (result.second && !ctrl_.empty())
+    indexInsert(result.first);
+  return result.first->second;
+}
 
-Value Parser::parseStart() {
-  skipWhiteSpace();
-  Value ret;
-  switch (*cur_) {
-  case '{':
-    ret = parseObject();
-    break;
-  case '[':
-    ret = parseArray();
-    break;
-  default:
-    throw Exception(Exception::ParseError::NOT_JSON);
-    break;
-  }
-  skipWhiteSpace();
-  if (*cur_ != '\0')
-    throw Exception(Exception::ParseError::ROOT_NOT_ONE);
-  return ret;
+Value &Object::operator[](std::string &&key) { return (*this)[key]; }
+
+Value &Object::operator[](const Key &key) {
+  ensureIndex();
+  if (const iterator *slot = findSlot(key))
+    return (*slot)->second;
+  auto result = object_data_.try_emplace(String(key.name));
+  if (result.second && !ctrl_.empty())
+    indexInsert(result.first);
+  return result.first->second;
 }
 
-void Parser::skipWhiteSpace() {
-  while (cur_ != end_ &&
-         (*cur_ == ' ' || *cur_ == '\n' || *cur_ == '\r' || *cur_ == '\t'))
-    cur_++;
+Object::iterator Object::find(const std::string &key) {
+  if (object_data_.size() >= indexThreshold())
+    return find(Key(key));
+  return object_data_.find(key);
 }
 
-void Parser::skipDigit() {
-  while (cur_ != end_ && std::isdigit(*cur_))
-    cur_++;
+Object::const_iterator Object::find(const std::string &key) const {
+  if (!ctrl_.empty())
+    return find(Key(key));
+  return object_data_.find(key);
 }
 
-Value Parser::parseObject() {
-  assert(*cur_ == '{');
-  cur_++;
-  skipWhiteSpace();
-  if (*cur_ == '}') {
-    cur_++;
-    return Object();
-  }
-  Object::object_t object_data;
-  while (true) {
-    skipWhiteSpace();
-    std::string key = parseRawString();
-    skipWhiteSpace();
-    if (*cur_ != ':')
-      throw Exception(Exception::ParseError::MISS_COLON);
-    cur_++;
-    skipWhiteSpace();
-    Value value = parseValue();
-    skipWhiteSpace();
-    object_data.emplace(unescapeJson(key), std::move(value));
-    if (*cur_ == ',') {
-      cur_++;
-    } else if (*cur_ == '}') {
-      cur_++;
-      break;
-    } else {
-      throw Exception(Exception::ParseError::LACK_COMMA_OR_BRACE);
-    }
-  }
-  return Object(std::move(object_data));
+Object::iterator Object::find(const Key &key) {
+  ensureIndex();
+  if (ctrl_.empty())
+    return object_data_.find(key.name);
+  const iterator *slot = findSlot(key);
+  return slot ? *slot : object_data_.end();
 }
 
-Value Parser::parseArray() {
-  assert(*cur_ == '[');
-  cur_++;
-  skipWhiteSpace();
-  if (*cur_ == ']') {
-    cur_++;
-    return Array();
+Object::const_iterator Object::find(const Key &key) const {
+  if (ctrl_.empty())
+    return object_data_.find(key.name);
+  const iterator *slot = findSlot(key);
+  return slot ? const_iterator(*slot) : object_data_.end();
+}
+
+Object::object_t::size_type Object::erase(const std::string &key) {
+  auto iter = find(key);
+  if (iter == end())
+    return 0;
+  erase(const_iterator(iter));
+  return 1;
+}
+
+Object::iterator Object::erase(const_iterator pos) {
+  if (!ctrl_.empty())
+    indexErase(pos);
+  iterator next = object_data_.erase(pos);
+  compactIndex();
+  return next;
+}
+
+Object::iterator Object::erase(const_iterator first, const_iterator last) {
+  if (!ctrl_.empty())
+    for (auto iter = first; iter != last; ++iter)
+      indexErase(iter);
+  iterator next = object_data_.erase(first, last);
+  compactIndex();
+  return next;
+}
+
+void Object::set_hash_index(HashIndex hash_index) {
+  hash_index_ = hash_index;
+  dropIndex();
+  ensureIndex();
+}
+
+Object::object_t::mapped_type &Object::at(const Key &key) {
+  auto iter = find(key);
+  if (iter == end())
+    throw std::out_of_range("smalljson::Object::at");
+  return iter->second;
+}
+
+const Object::object_t::mapped_type &Object::at(const Key &key) const {
+  auto iter = find(key);
+  if (iter == end())
+    throw std::out_of_range("smalljson::Object::at");
+  return iter->second;
+}
+
+// Bitmask of the bytes in a control group equal to `byte`.
+static uint32_t matchGroup(const uint8_t *group, uint8_t byte) {
+#ifdef __SSE2__
+  __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+  __m128i pattern = _mm_set1_epi8(static_cast<char>(byte));
+  return static_cast<uint32_t>(
+      _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, pattern)));
+#else
+  uint32_t mask = 0;
+  for (uint32_t idx = 0; idx < 16; idx++)
+    mask |= uint32_t(group[idx] == byte) << idx;
+  return mask;
+#endif
+}
+
+static uint32_t lowestBit(uint32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<uint32_t>(__builtin_ctz(mask));
+#else
+  uint32_t idx = 0;
+  while (!(mask & 1)) {
+    mask >>= 1;
+    idx++;
   }
-  Array::array_t array_data;
-  while (true) {
-    skipWhiteSpace();
-    Value value = parseValue();
-    skipWhiteSpace();
-    array_data.emplace_back(std::move(value));
-    if (*cur_ == ',') {
-      cur_++;
-    } else if (*cur_ == ']') {
-      cur_++;
-      break;
-    } else {
-      throw Exception(Exception::ParseError::LACK_COMMA_OR_BRACKET);
+  return idx;
+#endif
+}
+
+const Object::iterator *Object::findSlot(const Key &key) const {
+  if (ctrl_.empty())
+    return nullptr;
+  size_t mask = ctrl_.size() / kGroupSize - 1;
+  uint8_t tag = static_cast<uint8_t>(key.hash >> 25);
+  for (size_t group = key.hash & mask;; group = (group + 1) & mask) {
+    const uint8_t *ctrl = ctrl_.data() + group * kGroupSize;
+    for (uint32_t match = matchGroup(ctrl, tag); match; match &= match - 1) {
+      const iterator &entry = slots_[group * kGroupSize + lowestBit(match)];
+      const String &name = entry->first;
+      if (name.size() == key.name.size() &&
+          std::memcmp(name.data(), key.name.data(), name.size()) == 0)
+        return &entry;
     }
+    if (matchGroup(ctrl, kEmpty))
+      return nullptr;
   }
-  return Array(std::move(array_data));
 }
 
-Value Parser::parseValue() {
-  switch (*cur_) {
-  case 't':
-  case 'f':
-    return parseBoolean();
-  case 'n':
-    return parseNull();
-  case '"':
-    return parseString();
-  case '[':
-    return parseArray();
-  case '{':
-    return parseObject();
+size_t Object::indexThreshold() const noexcept {
+  switch (hash_index_) {
+  case HashIndex::Always:
+    return 1;
+  case HashIndex::Never:
+    return SIZE_MAX;
   default:
-    break;
+    return kIndexThreshold;
   }
-  if (*cur_ == '-' || std::isdigit(*cur_)) {
-    return parseNumber();
+}
+
+void Object::ensureIndex() {
+  if (ctrl_.empty() && object_data_.size() >= indexThreshold())
+    buildIndex();
+}
+
+void Object::buildIndex() {
+  // Keep at least one empty slot in 8 so probing always terminates.
+  size_t groups = 1;
+  while (groups * kGroupSize * 7 < (object_data_.size() + 1) * 8)
+    groups <<= 1;
+  ctrl_.assign(groups * kGroupSize, kEmpty);
+  slots_.assign(groups * kGroupSize, object_data_.end());
+  deleted_ = 0;
+  for (auto iter = object_data_.begin(); iter != object_data_.end(); ++iter)
+    placeEntry(iter, hashKey(iter->first));
+}
+
+void Object::indexInsert(iterator entry) {
+  // Tombstones are not empty slots either: count them against the load.
+  if ((object_data_.size() + deleted_) * 8 > ctrl_.size() * 7) {
+    buildIndex();
+    return;
   }
-  throw Exception(Exception::ParseError::BAD_VALUE);
-  return nullptr;
+  placeEntry(entry, hashKey(entry->first));
 }
 
-std::string Parser::parseRawString() {
-  if (*cur_ != '"') {
-    throw Exception(Exception::ParseError::BAD_KEY);
+void Object::placeEntry(iterator entry, uint32_t hash) {
+  size_t mask = ctrl_.size() / kGroupSize - 1;
+  for (size_t group = hash & mask;; group = (group + 1) & mask) {
+    uint8_t *ctrl = ctrl_.data() + group * kGroupSize;
+    if (uint32_t free = matchGroup(ctrl, kEmpty) | matchGroup(ctrl, kDeleted)) {
+      size_t pos = group * kGroupSize + lowestBit(free);
+      deleted_ -= ctrl_[pos] == kDeleted;
+      ctrl_[pos] = static_cast<uint8_t>(hash >> 25);
+      slots_[pos] = entry;
+      return;
+    }
   }
-  cur_++;
-  iterator_t old_cur = cur_;
-  while (cur_ != end_) {
-    if (*cur_ == '\\') {
-      cur_++;
-      if (cur_ == end_)
-        throw Exception(Exception::ParseError::BAD_ESCAPE);
-      switch (*cur_) {
-      case '"':
-      case '\\':
-      case '/':
-      case 't':
-      case 'r':
-      case 'n':
-      case 'u':
-      case 'b':
-      case 'f':
-        cur_++;
-        break;
-      default:
-        throw Exception(Exception::ParseError::BAD_ESCAPE);
-        break;
+}
+
+void Object::indexErase(const_iterator entry) {
+  uint32_t hash = hashKey(entry->first);
+  size_t mask = ctrl_.size() / kGroupSize - 1;
+  uint8_t tag = static_cast<uint8_t>(hash >> 25);
+  for (size_t group = hash & mask;; group = (group + 1) & mask) {
+    const uint8_t *ctrl = ctrl_.data() + group * kGroupSize;
+    for (uint32_t match = matchGroup(ctrl, tag); match; match &= match - 1) {
+      size_t pos = group * kGroupSize + lowestBit(match);
+      if (const_iterator(slots_[pos]) == entry) {
+        ctrl_[pos] = kDeleted;
+        slots_[pos] = object_data_.end();
+        deleted_++;
+        return;
       }
-    } else if (*cur_ == '"') {
-      cur_++;
-      break;
-    } else {
-      cur_++;
     }
+    if (matchGroup(ctrl, kEmpty))
+      return;
   }
-  if (cur_ == end_) {
-    throw Exception(Exception::ParseError::JSON_LENGTH);
-  }
-  return std::string(old_cur, cur_ - 1);
 }
 
-Value Parser::parseString() {
-  std::string str = parseRawString();
-  return Value(Value::ValueType::String, std::move(str));
+void Object::compactIndex() {
+  if (deleted_ * 8 <= ctrl_.size())
+    return;
+  if (object_data_.size() < indexThreshold())
+    dropIndex();
+  else
+    buildIndex();
 }
 
-Value Parser::parseBoolean() {
-  assert(*cur_ == 't' || *cur_ == 'f');
-  std::string str;
-  switch (*cur_) {
-  case 't':
-    str.assign(cur_, cur_ + 4 <= end_ ? cur_ + 4 : end_);
-    if (str == "true") {
-      cur_ += 4;
-      return Value(Value::ValueType::Boolean, std::move(str));
-    }
-    break;
-  case 'f':
-    str.assign(cur_, cur_ + 5 <= end_ ? cur_ + 5 : end_);
-    if (str == "false") {
-      cur_ += 5;
-      return Value(Value::ValueType::Boolean, std::move(str));
-    }
-    break;
-  default:
-    break;
-  }
-  throw Exception(Exception::ParseError::BAD_BOOLEAN);
-  return nullptr;
+Array::Array(const Array &rhs) : array_data_(rhs.array_data_) { countCopy(); }
+
+Array::Array(const array_t &array_data) : array_data_(array_data) {
+  countCopy();
 }
 
-Value Parser::parseNull() {
-  assert(*cur_ == 'n');
-  std::string str(cur_, cur_ + 4 <= end_ ? cur_ + 4 : end_);
-  if (str == "null") {
-    cur_ += 4;
-    return Value();
+Array &Array::operator=(const Array &rhs) {
+  if (this != &rhs) {
+    countCopy();
+    array_data_ = rhs.array_data_;
   }
-  throw Exception(Exception::ParseError::BAD_NULL);
-  return nullptr;
+  return *this;
 }
 
-Value Parser::parseNumber() {
-  iterator_t old_cur = cur_;
-  if (*cur_ == '-') {
-    cur_++;
+const std::string Array::to_print() const {
+  std::string out;
+  to_print(out);
+  return out;
+}
+
+void Array::to_print(std::string &out) const {
+  out += '[';
+  for (auto it = lookahead(array_data_); !it.done(); it.advance()) {
+    (*it).to_print(out);
+    out += ',';
   }
-  if (!std::isdigit(*cur_)) {
-    throw Exception(Exception::ParseError::BAD_NUMBER);
+  if (out.back() == ',') {
+    out.back() = ']';
+  } else {
+    out += ']';
   }
-  if (cur_ != end_ && *cur_ == '0' && cur_ + 1 != end_ &&
-      std::isdigit(*(cur_ + 1))) {
-    throw Exception(Exception::ParseError::BAD_NUMBER);
+}
+
+size_t Array::memory_usage() const noexcept {
+  size_t bytes = array_data_.capacity() * sizeof(Value);
+  for (auto it = lookahead(array_data_); !it.done(); it.advance())
+    bytes += (*it).memory_usage();
+  return bytes;
+}
+
+Value &Array::operator[](size_t idx) { return array_data_[idx]; }
+
+uint8_t Number::decode() const noexcept {
+  const char *last = text_ + len_;
+  uint64_t bits = 0;
+  uint8_t state = CachedDouble;
+  int64_t inum = 0;
+  if (kind() == Integer &&
+      std::from_chars(text_, last, inum).ec == std::errc()) {
+    std::memcpy(&bits, &inum, sizeof(bits));
+    state = CachedInt;
+  } else {
+    double dnum = detail::decodeDouble(text_, last);
+    std::memcpy(&bits, &dnum, sizeof(bits));
   }
-  skipDigit();
-  switch (*cur_) {
-  case '.':
-    cur_++;
-    skipDigit();
-    break;
-  case 'e':
-  case 'E':
-    cur_++;
-    if (cur_ == end_) {
-      throw Exception(Exception::ParseError::BAD_NUMBER);
+  cache_.store(bits, std::memory_order_relaxed);
+  state_.store(state, std::memory_order_release);
+  return state;
+}
+
+uint8_t classifyString(const char *str, size_t len) {
+  const unsigned char *cur = reinterpret_cast<const unsigned char *>(str);
+  const unsigned char *end = cur + len;
+  uint8_t flags = String::ValidUtf8;
+  while (cur != end) {
+    unsigned char ch = *cur;
+    if (ch < 0x80) {
+      if (ch < 0x20 || ch == '"' || ch == '\\')
+        flags |= String::HasEscapes;
+      cur++;
+      continue;
     }
-    if (*cur_ == '+' || *cur_ == '-') {
-      cur_++;
+    size_t extra = ch >= 0xf0 ? 3 : ch >= 0xe0 ? 2 : 1;
+    uint32_t code = ch & (0x3f >> extra);
+    bool valid = ch >= 0xc2 && ch <= 0xf4 && size_t(end - cur) > extra;
+    for (size_t idx = 1; valid && idx <= extra; idx++) {
+      valid = (cur[idx] & 0xc0) == 0x80;
+      code = (code << 6) | (cur[idx] & 0x3f);
     }
-    if (!std::isdigit(*cur_)) {
-      throw Exception(Exception::ParseError::BAD_NUMBER);
+    static const uint32_t min_code[4] = {0, 0x80, 0x800, 0x10000};
+    if (!valid || code < min_code[extra] || code > 0x10ffff ||
+        (code >= 0xd800 && code <= 0xdfff)) {
+      flags &= ~String::ValidUtf8;
+      cur++;
+    } else {
+      cur += extra + 1;
     }
-    skipDigit();
-  default:
-    break;
   }
-  return Value(Value::ValueType::Number, std::string(old_cur, cur_));
+  return flags;
 }
 
-std::string escapeJson(const std::string &str) {
-  std::string escapeStr(str);
-  std::string replaceStr[7] = {R"(\n)", R"(\t)", R"(\\)", R"(\b)",
-                               R"(\r)", R"(\")", R"(\f)"};
-  for (size_t idx = 0; idx < escapeStr.size(); idx++) {
-    size_t replaceIdx = 0;
-    switch (escapeStr[idx]) {
-    case '\n':
-      replaceIdx = 0;
-      break;
-    case '\t':
-      replaceIdx = 1;
+void detail::appendEscaped(std::string &out, std::string_view str) {
+  static const char hex[] = "0123456789abcdef";
+  size_t run = 0;
+  for (size_t idx = 0; idx < str.size(); idx++) {
+    unsigned char ch = str[idx];
+    if (ch >= 0x20 && ch != '"' && ch != '\\')
+      continue;
+    out.append(str.data() + run, idx - run);
+    run = idx + 1;
+    switch (ch) {
+    case '"':
+      out += "\\\"";
       break;
     case '\\':
-      replaceIdx = 2;
+      out += "\\\\";
       break;
     case '\b':
-      replaceIdx = 3;
+      out += "\\b";
+      break;
+    case '\f':
+      out += "\\f";
+      break;
+    case '\n':
+      out += "\\n";
       break;
     case '\r':
-      replaceIdx = 4;
+      out += "\\r";
       break;
-    case '\"':
-      replaceIdx = 5;
+    case '\t':
+      out += "\\t";
       break;
-    case '\f':
-      replaceIdx = 6;
     default:
-      continue;
+      out += "\\u00";
+      out += hex[ch >> 4];
+      out += hex[ch & 0xf];
+      break;
     }
-    escapeStr.replace(idx, 1, replaceStr[replaceIdx]);
-    idx++;
   }
-  return escapeStr;
+  out.append(str.data() + run, str.size() - run);
+}
+
+void appendQuoted(std::string &out, const String &str) {
+  out += '"';
+  if (str.has_escapes()) {
+    detail::appendEscaped(out, str.view());
+  } else {
+    out += str.view();
+  }
+  out += '"';
+}
+
+void detail::appendNumber(std::string &out, int64_t num) {
+  char buf[24];
+  out.append(buf, std::to_chars(buf, buf + sizeof(buf), num).ptr);
 }
 
-std::string unescapeJson(const std::string &str) {
-  std::string unescapeStr(str);
-  std::string replaceStr[7] = {"\n", "\t", "\\", "\b", "\r", "\"", "\f"};
-  for (size_t idx = 0; idx < unescapeStr.size(); idx++) {
-    if (unescapeStr[idx] != '\\')
+void detail::appendNumber(std::string &out, double num) {
+  char buf[32];
+  if (num == 0 && std::signbit(num)) {
+    // "-0" would read back as the integer 0.
+    out += "-0.0";
+  } else if (std::isfinite(num)) {
+    out.append(buf, std::to_chars(buf, buf + sizeof(buf), num).ptr);
+  } else {
+    out += "null";
+  }
+}
+
+void appendNumber(std::string &out, const Value::value_t &num) {
+  if (auto pval = std::get_if<int64_t>(&num)) {
+    detail::appendNumber(out, *pval);
+  } else if (auto pval = std::get_if<double>(&num)) {
+    detail::appendNumber(out, *pval);
+  } else if (auto pval = std::get_if<Number>(&num)) {
+    out += pval->text();
+  } else {
+    out += std::get<String>(num).view();
+  }
+}
+
+static uint32_t parseHex4(std::string_view str, size_t pos) {
+  if (pos + 4 > str.size())
+    throw Exception(Exception::ParseError::BAD_ESCAPE);
+  uint32_t code = 0;
+  auto [ptr, ec] = std::from_chars(str.data() + pos, str.data() + pos + 4,
+                                   code, 16);
+  if (ec != std::errc() || ptr != str.data() + pos + 4)
+    throw Exception(Exception::ParseError::BAD_ESCAPE);
+  return code;
+}
+
+static void appendUtf8(std::string &out, uint32_t code) {
+  if (code < 0x80) {
+    out += static_cast<char>(code);
+  } else if (code < 0x800) {
+    out += static_cast<char>(0xc0 | (code >> 6));
+    out += static_cast<char>(0x80 | (code & 0x3f));
+  } else if (code < 0x10000) {
+    out += static_cast<char>(0xe0 | (code >> 12));
+    out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+    out += static_cast<char>(0x80 | (code & 0x3f));
+  } else {
+    out += static_cast<char>(0xf0 | (code >> 18));
+    out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+    out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+    out += static_cast<char>(0x80 | (code & 0x3f));
+  }
+}
+
+std::string detail::unescapeJson(std::string_view str) {
+  std::string out;
+  out.reserve(str.size());
+  size_t run = 0;
+  for (size_t idx = 0; idx < str.size(); idx++) {
+    if (str[idx] != '\\')
       continue;
-    size_t replaceIdx = 0;
-    switch (unescapeStr[idx + 1]) {
+    out.append(str.data() + run, idx - run);
+    if (idx + 1 == str.size())
+      throw Exception(Exception::ParseError::BAD_ESCAPE);
+    switch (str[++idx]) {
     case 'n':
-      replaceIdx = 0;
+      out += '\n';
       break;
     case 't':
-      replaceIdx = 1;
-      break;
-    case '\\':
-      replaceIdx = 2;
+      out += '\t';
       break;
     case 'b':
-      replaceIdx = 3;
+      out += '\b';
       break;
     case 'r':
-      replaceIdx = 4;
+      out += '\r';
+      break;
+    case 'f':
+      out += '\f';
       break;
     case '"':
-      replaceIdx = 5;
+    case '\\':
+    case '/':
+      out += str[idx];
       break;
-    case 'f':
-      replaceIdx = 6;
+    case 'u': {
+      uint32_t code = parseHex4(str, idx + 1);
+      idx += 4;
+      if (code >= 0xd800 && code <= 0xdbff && idx + 2 < str.size() &&
+          str[idx + 1] == '\\' && str[idx + 2] == 'u') {
+        uint32_t low = parseHex4(str, idx + 3);
+        if (low >= 0xdc00 && low <= 0xdfff) {
+          code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+          idx += 6;
+        }
+      }
+      if (code >= 0xd800 && code <= 0xdfff)
+        code = 0xfffd;
+      appendUtf8(out, code);
+      break;
+    }
     default:
+      throw Exception(Exception::ParseError::BAD_ESCAPE);
+    }
+    run = idx + 1;
+  }
+  out.append(str.data() + run, str.size() - run);
+  return out;
+}
+
+// Past the closing quote of the string opening at cur.
+static const char *skipString(const char *cur, const char *end,
+                              bool &escaped) {
+  for (cur++; cur != end; cur++) {
+    if (*cur == '\\') {
+      escaped = true;
+      if (++cur == end)
+        break;
+    } else if (*cur == '"') {
+      return cur + 1;
+    }
+  }
+  throw Exception(Exception::ParseError::JSON_LENGTH);
+}
+
+// Bitmasks of the quotes, backslashes and opening and closing brackets in
+// a 64-byte block. `ch | 0x20` folds '[' onto '{' and ']' onto '}'.
+struct BlockMasks {
+  uint64_t quote, escape, open, close;
+};
+
+static BlockMasks classifyBlock(const char *block) {
+  BlockMasks masks{0, 0, 0, 0};
+#ifdef __SSE2__
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i escape = _mm_set1_epi8('\\');
+  const __m128i open = _mm_set1_epi8('{');
+  const __m128i close = _mm_set1_epi8('}');
+  const __m128i fold = _mm_set1_epi8(0x20);
+  for (int part = 0; part < 4; part++) {
+    __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + part * 16));
+    __m128i folded = _mm_or_si128(bytes, fold);
+    int shift = part * 16;
+    masks.quote |= uint64_t(static_cast<uint16_t>(
+                       _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, quote))))
+                   << shift;
+    masks.escape |= uint64_t(static_cast<uint16_t>(
+                        _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, escape))))
+                    << shift;
+    masks.open |= uint64_t(static_cast<uint16_t>(
+                      _mm_movemask_epi8(_mm_cmpeq_epi8(folded, open))))
+                  << shift;
+    masks.close |= uint64_t(static_cast<uint16_t>(
+                       _mm_movemask_epi8(_mm_cmpeq_epi8(folded, close))))
+                   << shift;
+  }
+#else
+  for (int idx = 0; idx < 64; idx++) {
+    char ch = block[idx];
+    char folded = static_cast<char>(ch | 0x20);
+    masks.quote |= uint64_t(ch == '"') << idx;
+    masks.escape |= uint64_t(ch == '\\') << idx;
+    masks.open |= uint64_t(folded == '{') << idx;
+    masks.close |= uint64_t(folded == '}') << idx;
+  }
+#endif
+  return masks;
+}
+
+static unsigned lowestBit64(uint64_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<unsigned>(__builtin_ctzll(mask));
+#else
+  unsigned idx = 0;
+  while (!(mask & 1)) {
+    mask >>= 1;
+    idx++;
+  }
+  return idx;
+#endif
+}
+
+// Matches the brackets of the container opening at cur. Whole 64-byte
+// blocks are classified at once and only their quotes, backslashes and
+// brackets are visited; the tail is scanned byte by byte with the same
+// state.
+static const char *skipContainer(const char *cur, const char *end) {
+  size_t depth = 0;
+  bool in_string = false;
+  bool escaped_first = false;
+  for (; end - cur >= 64; cur += 64) {
+    BlockMasks masks = classifyBlock(cur);
+    uint64_t bits = masks.quote | masks.escape | masks.open | masks.close;
+    if (escaped_first)
+      bits &= ~uint64_t(1);
+    escaped_first = false;
+    while (bits) {
+      unsigned idx = lowestBit64(bits);
+      uint64_t bit = uint64_t(1) << idx;
+      bits &= bits - 1;
+      if (in_string) {
+        if (masks.escape & bit) {
+          if (idx == 63)
+            escaped_first = true;
+          else
+            bits &= ~(bit << 1);
+        } else if (masks.quote & bit) {
+          in_string = false;
+        }
+      } else if (masks.quote & bit) {
+        in_string = true;
+      } else if (masks.open & bit) {
+        depth++;
+      } else if ((masks.close & bit) && --depth == 0) {
+        return cur + idx + 1;
+      }
+    }
+  }
+  if (escaped_first && cur != end)
+    cur++;
+  for (; cur != end; cur++) {
+    char ch = *cur;
+    if (in_string) {
+      if (ch == '\\') {
+        if (++cur == end)
+          break;
+      } else if (ch == '"') {
+        in_string = false;
+      }
+    } else if (ch == '"') {
+      in_string = true;
+    } else if (ch == '{' || ch == '[') {
+      depth++;
+    } else if ((ch == '}' || ch == ']') && --depth == 0) {
+      return cur + 1;
+    }
+  }
+  throw Exception(Exception::ParseError::JSON_LENGTH);
+}
+
+namespace detail {
+double decodeDouble(const char *first, const char *last) noexcept {
+  double num = 0;
+  if (std::from_chars(first, last, num).ec != std::errc::result_out_of_range)
+    return num;
+  // Out of range: which way follows from where the first significant digit
+  // sits relative to the decimal point, shifted by the exponent.
+  const char *cur = first;
+  bool negative = cur != last && *cur == '-';
+  cur += negative;
+  bool significant = false;
+  long scale = 0;
+  for (; cur != last && *cur >= '0' && *cur <= '9'; cur++) {
+    significant |= *cur != '0';
+    scale += significant;
+  }
+  if (cur != last && *cur == '.') {
+    for (cur++; cur != last && *cur >= '0' && *cur <= '9'; cur++) {
+      if (!significant && *cur == '0')
+        scale--;
+      significant |= *cur != '0';
+    }
+  }
+  long exponent = 0;
+  if (cur != last && (*cur == 'e' || *cur == 'E')) {
+    cur++;
+    bool below = cur != last && *cur == '-';
+    cur += cur != last && (*cur == '+' || *cur == '-');
+    for (; cur != last && *cur >= '0' && *cur <= '9'; cur++)
+      if (exponent < 100000)
+        exponent = exponent * 10 + (*cur - '0');
+    exponent = below ? -exponent : exponent;
+  }
+  num = significant && scale + exponent > 0 ? HUGE_VAL : 0.0;
+  return negative ? -num : num;
+}
+
+const char *skipValue(const char *cur, const char *end) {
+  if (cur == end)
+    throw Exception(Exception::ParseError::MISS_VALUE);
+  bool escaped = false;
+  if (*cur == '"')
+    return skipString(cur, end, escaped);
+  if (*cur == '{' || *cur == '[')
+    return skipContainer(cur, end);
+  const char *first = cur;
+  while (cur != end && *cur != ',' && *cur != '}' && *cur != ']' &&
+         *cur != ' ' && *cur != '\n' && *cur != '\r' && *cur != '\t')
+    cur++;
+  if (cur == first)
+    throw Exception(Exception::ParseError::BAD_VALUE);
+  return cur;
+}
+} // namespace detail
+
+void Cursor::skip_whitespace() {
+  while (cur_ != end_ &&
+         (*cur_ == ' ' || *cur_ == '\n' || *cur_ == '\r' || *cur_ == '\t'))
+    cur_++;
+}
+
+bool Cursor::consume(char ch) {
+  skip_whitespace();
+  if (cur_ != end_ && *cur_ == ch) {
+    cur_++;
+    return true;
+  }
+  return false;
+}
+
+void Cursor::expect(char ch, Exception::ParseError err) {
+  if (!consume(ch))
+    throw Exception(err);
+}
+
+bool Cursor::consume_null() {
+  skip_whitespace();
+  if (end_ - cur_ >= 4 && std::memcmp(&*cur_, "null", 4) == 0) {
+    cur_ += 4;
+    return true;
+  }
+  return false;
+}
+
+void Cursor::finish() {
+  skip_whitespace();
+  if (cur_ != end_)
+    throw Exception(Exception::ParseError::ROOT_NOT_ONE);
+}
+
+std::string_view Cursor::read_key() {
+  skip_whitespace();
+  if (cur_ == end_ || *cur_ != '"')
+    throw Exception(Exception::ParseError::BAD_KEY);
+  BasicParser<> parser(cur_, end_);
+  bool escaped = false;
+  std::string_view key = parser.parseRawString(escaped);
+  cur_ = parser.cur_;
+  return key;
+}
+
+void Cursor::expectNumber() const {
+  if (cur_ == end_)
+    throw Exception(Exception::ParseError::MISS_VALUE);
+  if (*cur_ == '-' || (*cur_ >= '0' && *cur_ <= '9'))
+    return;
+  // Another kind of value is a type mismatch; anything else is not JSON,
+  // reported as Parser reports it.
+  if (std::string_view("\"{[tfn").find(*cur_) != std::string_view::npos)
+    throw Exception(Exception::ParseError::BAD_TYPE);
+  throw Exception(Exception::ParseError::BAD_VALUE);
+}
+
+int64_t Cursor::read_int64() {
+  skip_whitespace();
+  expectNumber();
+  BasicParser<> parser(cur_, end_);
+  Value value = parser.parseNumber();
+  // Fractions, exponents and integers beyond int64_t are not int64s.
+  const int64_t *num = value.get_if<int64_t>();
+  if (!num)
+    throw Exception(Exception::ParseError::BAD_NUMBER);
+  cur_ = parser.cur_;
+  return *num;
+}
+
+double Cursor::read_double() {
+  skip_whitespace();
+  expectNumber();
+  BasicParser<> parser(cur_, end_);
+  std::optional<double> num = parser.parseNumber().get<double>();
+  if (!num)
+    throw Exception(Exception::ParseError::BAD_NUMBER);
+  cur_ = parser.cur_;
+  return *num;
+}
+
+bool Cursor::read_boolean() {
+  skip_whitespace();
+  if (cur_ == end_ || (*cur_ != 't' && *cur_ != 'f'))
+    throw Exception(Exception::ParseError::BAD_TYPE);
+  BasicParser<> parser(cur_, end_);
+  bool value = parser.parseBoolean().to_boolean();
+  cur_ = parser.cur_;
+  return value;
+}
+
+std::string Cursor::read_string() {
+  skip_whitespace();
+  if (cur_ == end_ || *cur_ != '"')
+    throw Exception(Exception::ParseError::BAD_TYPE);
+  BasicParser<> parser(cur_, end_);
+  bool escaped = false;
+  std::string_view raw = parser.parseRawString(escaped);
+  cur_ = parser.cur_;
+  return escaped ? detail::unescapeJson(raw) : std::string(raw);
+}
+
+Value Cursor::read_value() {
+  skip_whitespace();
+  BasicParser<> parser(cur_, end_);
+  Value value = parser.parseValue();
+  cur_ = parser.cur_;
+  return value;
+}
+
+std::string_view Cursor::skip_value() {
+  skip_whitespace();
+  if (cur_ == end_)
+    throw Exception(Exception::ParseError::MISS_VALUE);
+  const char *first = &*cur_;
+  const char *last = detail::skipValue(first, first + (end_ - cur_));
+  cur_ += last - first;
+  return std::string_view(first, last - first);
+}
+
+std::string Cursor::unescape(std::string_view raw) {
+  return detail::unescapeJson(raw);
+}
+
+bool JsonReader::next() {
+  try {
+    return step();
+  } catch (Exception &err) {
+    err.offset_ = cur_ - begin_;
+    throw;
+  }
+}
+
+bool JsonReader::step() {
+  skipWhitespace();
+  key_ = {};
+  raw_ = {};
+  if (stack_.empty()) {
+    if (token_ != Token::None) {
+      if (cur_ != end_)
+        throw Exception(Exception::ParseError::ROOT_NOT_ONE);
+      return false;
+    }
+    if (cur_ == end_ || (*cur_ != '{' && *cur_ != '['))
+      throw Exception(Exception::ParseError::NOT_JSON);
+    readValue();
+    return true;
+  }
+  bool object = stack_.back() == '{';
+  char close = object ? '}' : ']';
+  if (!first_ && cur_ != end_ && *cur_ == ',') {
+    cur_++;
+    skipWhitespace();
+    if (cur_ == end_ || *cur_ == close)
+      throw Exception(object ? Exception::ParseError::BAD_KEY
+                             : Exception::ParseError::BAD_VALUE);
+  } else if (cur_ != end_ && *cur_ == close) {
+    cur_++;
+    stack_.pop_back();
+    first_ = false;
+    token_ = object ? Token::EndObject : Token::EndArray;
+    return true;
+  } else if (!first_) {
+    throw Exception(object ? Exception::ParseError::LACK_COMMA_OR_BRACE
+                           : Exception::ParseError::LACK_COMMA_OR_BRACKET);
+  }
+  first_ = false;
+  if (object)
+    readKey();
+  readValue();
+  return true;
+}
+
+std::string JsonReader::get_string() const {
+  if (token_ != Token::String)
+    throw Exception(Exception::ParseError::BAD_TYPE);
+  return escaped_ ? detail::unescapeJson(raw_) : std::string(raw_);
+}
+
+double JsonReader::get_double() const {
+  if (token_ != Token::Number)
+    throw Exception(Exception::ParseError::BAD_TYPE);
+  return detail::decodeDouble(raw_.data(), raw_.data() + raw_.size());
+}
+
+int64_t JsonReader::get_int64() const {
+  if (token_ != Token::Number)
+    throw Exception(Exception::ParseError::BAD_TYPE);
+  int64_t value = 0;
+  auto [ptr, ec] = std::from_chars(raw_.data(), raw_.data() + raw_.size(),
+                                   value);
+  if (ec != std::errc() || ptr != raw_.data() + raw_.size())
+    throw Exception(Exception::ParseError::BAD_NUMBER);
+  return value;
+}
+
+bool JsonReader::get_boolean() const {
+  if (token_ != Token::Boolean)
+    throw Exception(Exception::ParseError::BAD_TYPE);
+  return raw_[0] == 't';
+}
+
+void JsonReader::skip() {
+  if (token_ != Token::BeginObject && token_ != Token::BeginArray)
+    return;
+  const char *first = &*(cur_ - 1);
+  const char *last = first + (end_ - cur_ + 1);
+  cur_ += detail::skipValue(first, last) - first - 1;
+  stack_.pop_back();
+  first_ = false;
+  key_ = std::string_view();
+  token_ = token_ == Token::BeginObject ? Token::EndObject : Token::EndArray;
+}
+
+void JsonReader::skipWhitespace() {
+  while (cur_ != end_ &&
+         (*cur_ == ' ' || *cur_ == '\n' || *cur_ == '\r' || *cur_ == '\t'))
+    cur_++;
+}
+
+void JsonReader::readKey() {
+  if (cur_ == end_ || *cur_ != '"')
+    throw Exception(Exception::ParseError::BAD_KEY);
+  BasicParser<> parser(cur_, end_);
+  bool escaped = false;
+  key_ = parser.parseRawString(escaped);
+  cur_ = parser.cur_;
+  if (escaped) {
+    key_buf_ = detail::unescapeJson(key_);
+    key_ = key_buf_;
+  }
+  skipWhitespace();
+  if (cur_ == end_ || *cur_ != ':')
+    throw Exception(Exception::ParseError::MISS_COLON);
+  cur_++;
+  skipWhitespace();
+}
+
+void JsonReader::readValue() {
+  if (cur_ == end_)
+    throw Exception(Exception::ParseError::MISS_VALUE);
+  iterator_t start = cur_;
+  switch (*cur_) {
+  case '{':
+  case '[':
+    stack_.push_back(*cur_);
+    cur_++;
+    first_ = true;
+    token_ = *start == '{' ? Token::BeginObject : Token::BeginArray;
+    return;
+  case '"': {
+    BasicParser<> parser(cur_, end_);
+    escaped_ = false;
+    raw_ = parser.parseRawString(escaped_);
+    cur_ = parser.cur_;
+    token_ = Token::String;
+    return;
+  }
+  case 't':
+  case 'f': {
+    BasicParser<> parser(cur_, end_);
+    parser.parseBoolean();
+    cur_ = parser.cur_;
+    token_ = Token::Boolean;
+    break;
+  }
+  case 'n': {
+    BasicParser<> parser(cur_, end_);
+    parser.parseNull();
+    cur_ = parser.cur_;
+    token_ = Token::Null;
+    break;
+  }
+  default: {
+    // Not the start of any value: reported as Parser reports it.
+    if (*cur_ != '-' && (*cur_ < '0' || *cur_ > '9'))
+      throw Exception(Exception::ParseError::BAD_VALUE);
+    // The zero-copy parser validates the number without converting it.
+    BasicParser<RuntimeOptions<NumberMode::Binary, DuplicateKeys::LastWins,
+                               true>>
+        parser(cur_, end_);
+    parser.parseNumber();
+    cur_ = parser.cur_;
+    token_ = Token::Number;
+    break;
+  }
+  }
+  raw_ = std::string_view(&*start, cur_ - start);
+}
+
+bool JsonStream::next(Value &value) {
+  iterator_t start = cur_;
+  while (start != end_ &&
+         (*start == ' ' || *start == '\n' || *start == '\r' || *start == '\t'))
+    start++;
+  partial_ = false;
+  cur_ = start;
+  if (start == end_)
+    return false;
+  BasicParser<> parser(start, end_);
+  try {
+    value = parser.parseContainer();
+  } catch (Exception &err) {
+    // A root cut short fails wherever the input happens to stop, in the
+    // middle of a literal as well. The bracket scan, which only stops
+    // early when the input runs out, tells it apart from a malformed one.
+    const char *first = &*start;
+    try {
+      detail::skipValue(first, first + (end_ - start));
+    } catch (const Exception &) {
+      partial_ = true;
+      return false;
+    }
+    err.offset_ = parser.cur_ - begin_;
+    throw;
+  }
+  cur_ = parser.cur_;
+  return true;
+}
+
+std::string FrozenValue::to_string() const {
+  if (!isString())
+    throw Exception(Exception::ParseError::BAD_TYPE);
+  return detail::unescapeJson(node().text);
+}
+
+Value FrozenValue::to_value() const {
+  switch (type()) {
+  case Value::ValueType::Object: {
+    Object::object_t object_data;
+    for (uint32_t child = idx_ + 1; child < node().next;
+         child = nodes_[child + 1].next) {
+      // Last wins, Parser's default.
+      object_data.insert_or_assign(FrozenValue(nodes_, child).to_string(),
+                                   FrozenValue(nodes_, child + 1).to_value());
+    }
+    return Object(std::move(object_data));
+  }
+  case Value::ValueType::Array: {
+    Array::array_t array_data;
+    array_data.reserve(node().size);
+    for (uint32_t child = idx_ + 1; child < node().next;
+         child = nodes_[child].next) {
+      array_data.emplace_back(FrozenValue(nodes_, child).to_value());
+    }
+    return Array(std::move(array_data));
+  }
+  case Value::ValueType::Null:
+    return Value();
+  case Value::ValueType::String:
+    return Value(to_string());
+  case Value::ValueType::Number: {
+    std::string_view text = node().text;
+    return BasicParser<RuntimeOptions<NumberMode::Lossless>>(
+               text.data(), text.data() + text.size())
+        .parseNumber();
+  }
+  default:
+    return Value(type(), String(node().text));
+  }
+}
+
+Builder::Node &Builder::push(Value::ValueType type, Repr repr) {
+  if (open_.empty() ? !nodes_.empty() : expect_key_)
+    throw std::logic_error(open_.empty()
+                               ? "smalljson::Builder: document complete"
+                               : "smalljson::Builder: key expected");
+  if (!open_.empty()) {
+    Node &parent = nodes_[open_.back()];
+    if (parent.type == Value::ValueType::Array)
+      parent.size++;
+    else
+      expect_key_ = true;
+  }
+  uint32_t idx = static_cast<uint32_t>(nodes_.size());
+  nodes_.push_back(Node{type, repr, 0, idx + 1, {0}});
+  return nodes_.back();
+}
+
+void Builder::appendText(Node &node, std::string_view text) {
+  node.offset = text_.size();
+  node.size = static_cast<uint32_t>(text.size());
+  text_ += text;
+}
+
+Builder &Builder::beginContainer(Value::ValueType type) {
+  push(type, Plain);
+  open_.push_back(static_cast<uint32_t>(nodes_.size() - 1));
+  expect_key_ = type == Value::ValueType::Object;
+  return *this;
+}
+
+Builder &Builder::endContainer(Value::ValueType type) {
+  if (open_.empty() || nodes_[open_.back()].type != type ||
+      (type == Value::ValueType::Object && !expect_key_))
+    throw std::logic_error("smalljson::Builder: unbalanced end");
+  nodes_[open_.back()].next = static_cast<uint32_t>(nodes_.size());
+  open_.pop_back();
+  expect_key_ =
+      !open_.empty() && nodes_[open_.back()].type == Value::ValueType::Object;
+  return *this;
+}
+
+Builder &Builder::begin_object() {
+  return beginContainer(Value::ValueType::Object);
+}
+
+Builder &Builder::end_object() { return endContainer(Value::ValueType::Object); }
+
+Builder &Builder::begin_array() { return beginContainer(Value::ValueType::Array); }
+
+Builder &Builder::end_array() { return endContainer(Value::ValueType::Array); }
+
+Builder &Builder::key(std::string_view name) {
+  if (open_.empty() || !expect_key_)
+    throw std::logic_error("smalljson::Builder: key outside an object");
+  nodes_[open_.back()].size++;
+  uint32_t idx = static_cast<uint32_t>(nodes_.size());
+  nodes_.push_back(Node{Value::ValueType::String, Text, 0, idx + 1, {0}});
+  appendText(nodes_.back(), name);
+  expect_key_ = false;
+  return *this;
+}
+
+Builder &Builder::value(std::nullptr_t) {
+  push(Value::ValueType::Null, Plain);
+  return *this;
+}
+
+Builder &Builder::value(bool boolean) {
+  push(Value::ValueType::Boolean, Plain).int_num = boolean;
+  return *this;
+}
+
+Builder &Builder::value(std::string_view str) {
+  appendText(push(Value::ValueType::String, Text), str);
+  return *this;
+}
+
+Builder &Builder::number(int64_t num) {
+  push(Value::ValueType::Number, Int).int_num = num;
+  return *this;
+}
+
+Builder &Builder::number(double num) {
+  push(Value::ValueType::Number, Double).dbl_num = num;
+  return *this;
+}
+
+Builder &Builder::numberText(std::string_view text) {
+  appendText(push(Value::ValueType::Number, Text), text);
+  return *this;
+}
+
+Builder &Builder::value(const Value &value) {
+  switch (value.type()) {
+  case Value::ValueType::Null:
+    return this->value(nullptr);
+  case Value::ValueType::Boolean:
+    return this->value(*value.get<bool>());
+  case Value::ValueType::String:
+    return this->value(*value.get<std::string_view>());
+  case Value::ValueType::Number:
+    if (auto pval = value.get_if<int64_t>())
+      return number(*pval);
+    if (auto pval = value.get_if<double>())
+      return number(*pval);
+    return numberText(value.to_print());
+  case Value::ValueType::Array:
+    begin_array();
+    for (auto &item : *value.get_if<Array>())
+      this->value(item);
+    return end_array();
+  default:
+    begin_object();
+    for (auto &[name, item] : *value.get_if<Object>())
+      key(name.view()).value(item);
+    return end_object();
+  }
+}
+
+Value Builder::build() const {
+  if (!complete())
+    throw std::logic_error("smalljson::Builder: document incomplete");
+  // Depth-first over the tape with an explicit stack, so nesting depth is
+  // bounded by memory rather than by the C stack.
+  struct Level {
+    uint32_t idx;
+    Array::array_t items;
+    Object::object_t members;
+    String name;
+  };
+  std::vector<Level> levels;
+  uint32_t idx = 0;
+  for (;;) {
+    const Node &node = nodes_[idx];
+    Value value;
+    uint32_t after = node.next;
+    if (node.type == Value::ValueType::Array ||
+        node.type == Value::ValueType::Object) {
+      levels.push_back(Level{idx, {}, {}, {}});
+      if (node.type == Value::ValueType::Array)
+        levels.back().items.reserve(node.size);
+      if (node.size != 0) {
+        idx++;
+        if (node.type == Value::ValueType::Object)
+          levels.back().name = String(text(nodes_[idx++]));
+        continue;
+      }
+      after = idx;
+    } else {
+      value = buildLeaf(node);
+    }
+    // Hand the finished value to its parent; close every container whose
+    // last member it was.
+    for (;;) {
+      if (levels.empty())
+        return value;
+      Level &level = levels.back();
+      const Node &parent = nodes_[level.idx];
+      if (after != level.idx) {
+        if (parent.type == Value::ValueType::Array)
+          level.items.emplace_back(std::move(value));
+        else
+          level.members.insert_or_assign(std::move(level.name),
+                                         std::move(value));
+        if (after < parent.next) {
+          idx = after;
+          if (parent.type == Value::ValueType::Object)
+            level.name = String(text(nodes_[idx++]));
+          break;
+        }
+      }
+      if (parent.type == Value::ValueType::Array)
+        value = Array(std::move(level.items));
+      else
+        value = Object(std::move(level.members));
+      after = parent.next;
+      levels.pop_back();
+    }
+  }
+}
+
+Value Builder::buildLeaf(const Node &node) const {
+  switch (node.type) {
+  case Value::ValueType::Null:
+    return Value();
+  case Value::ValueType::Boolean:
+    return Value(node.int_num != 0);
+  case Value::ValueType::String:
+    return Value(text(node));
+  default:
+    if (node.repr == Int)
+      return Value(node.int_num);
+    if (node.repr == Double)
+      return Value(node.dbl_num);
+    return Value(Value::ValueType::Number, String(text(node)));
+  }
+}
+
+const std::string Builder::to_print() const {
+  std::string out;
+  to_print(out);
+  return out;
+}
+
+void Builder::to_print(std::string &out) const {
+  if (!complete())
+    throw std::logic_error("smalljson::Builder: document incomplete");
+  struct Level {
+    uint32_t end;
+    char closer;
+    bool key_next;
+  };
+  std::vector<Level> levels;
+  auto close = [&] {
+    if (out.back() == ',') {
+      out.back() = levels.back().closer;
+    } else {
+      out += levels.back().closer;
+    }
+    out += ',';
+    levels.pop_back();
+  };
+  for (uint32_t idx = 0; idx < nodes_.size(); idx++) {
+    while (!levels.empty() && levels.back().end == idx)
+      close();
+    const Node &node = nodes_[idx];
+    if (!levels.empty() && levels.back().key_next) {
+      out += '"';
+      detail::appendEscaped(out, text(node));
+      out += "\":";
+      levels.back().key_next = false;
+      continue;
+    }
+    if (!levels.empty() && levels.back().closer == '}')
+      levels.back().key_next = true;
+    switch (node.type) {
+    case Value::ValueType::Object:
+      out += '{';
+      levels.push_back(Level{node.next, '}', true});
+      continue;
+    case Value::ValueType::Array:
+      out += '[';
+      levels.push_back(Level{node.next, ']', false});
+      continue;
+    case Value::ValueType::Null:
+      out += "null";
+      break;
+    case Value::ValueType::Boolean:
+      out += node.int_num ? "true" : "false";
+      break;
+    case Value::ValueType::String:
+      out += '"';
+      detail::appendEscaped(out, text(node));
+      out += '"';
+      break;
+    default:
+      if (node.repr == Int)
+        detail::appendNumber(out, node.int_num);
+      else if (node.repr == Double)
+        detail::appendNumber(out, node.dbl_num);
+      else
+        out += text(node);
+      break;
+    }
+    out += ',';
+  }
+  while (!levels.empty())
+    close();
+  out.pop_back();
+}
+
+void Builder::clear() noexcept {
+  nodes_.clear();
+  text_.clear();
+  open_.clear();
+  expect_key_ = false;
+}
+
+NdjsonWriter::NdjsonWriter(std::ostream &out, size_t block_size,
+                           bool background)
+    : out_(out), block_size_(block_size), background_(background) {
+  buffer_.reserve(block_size_ + block_size_ / 8);
+  if (background_)
+    thread_ = std::thread(&NdjsonWriter::writerLoop, this);
+}
+
+NdjsonWriter::~NdjsonWriter() {
+  try {
+    flush();
+  } catch (...) {
+  }
+  if (background_) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+  }
+}
+
+void NdjsonWriter::write(const Value &record) {
+  record.to_print(buffer_);
+  endRecord();
+}
+
+void NdjsonWriter::write_batch(const std::vector<Value> &records,
+                               unsigned threads) {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = static_cast<unsigned>(
+      std::min<size_t>(threads, (records.size() + 63) / 64));
+  if (threads <= 1) {
+    for (auto &record : records)
+      write(record);
+    return;
+  }
+  std::vector<std::string> parts(threads);
+  detail::runParts(threads, [&](unsigned part) {
+    size_t first = records.size() * part / threads;
+    size_t last = records.size() * (part + 1) / threads;
+    for (size_t idx = first; idx < last; idx++) {
+      records[idx].to_print(parts[part]);
+      parts[part] += '\n';
+    }
+  });
+  for (auto &part : parts) {
+    buffer_ += part;
+    if (buffer_.size() >= block_size_)
+      flushBlock();
+  }
+}
+
+void NdjsonWriter::flush() {
+  flushBlock();
+  if (background_) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this] { return !busy_; });
+  }
+  checkError();
+  // The writer thread is idle here, so the stream may be touched directly.
+  out_.flush();
+  if (!out_)
+    throw std::runtime_error("smalljson::NdjsonWriter: write failed");
+}
+
+void NdjsonWriter::flushBlock() {
+  checkError();
+  if (buffer_.empty())
+    return;
+  if (!background_) {
+    out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    buffer_.clear();
+    return;
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this] { return !busy_; });
+    pending_.swap(buffer_);
+    busy_ = true;
+  }
+  cond_.notify_all();
+  buffer_.clear();
+}
+
+void NdjsonWriter::writerLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cond_.wait(lock, [this] { return busy_ || stop_; });
+    if (!busy_)
+      return;
+    lock.unlock();
+    out_.write(pending_.data(), static_cast<std::streamsize>(pending_.size()));
+    bool failed = !out_;
+    pending_.clear();
+    lock.lock();
+    failed_ = failed_ || failed;
+    busy_ = false;
+    cond_.notify_all();
+  }
+}
+
+void NdjsonWriter::checkError() {
+  bool failed;
+  if (background_) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    failed = failed_;
+  } else {
+    failed = !out_;
+  }
+  if (failed)
+    throw std::runtime_error("smalljson::NdjsonWriter: write failed");
+}
+
+static const char *skipSpace(const char *cur, const char *end) {
+  while (cur != end &&
+         (*cur == ' ' || *cur == '\n' || *cur == '\r' || *cur == '\t'))
+    cur++;
+  return cur;
+}
+
+static bool parseIndex(const std::string &token, size_t &index) {
+  if (token.empty() || (token.size() > 1 && token[0] == '0'))
+    return false;
+  auto [ptr, ec] =
+      std::from_chars(token.data(), token.data() + token.size(), index);
+  return ec == std::errc() && ptr == token.data() + token.size();
+}
+
+namespace {
+// Finds what several JSON Pointers point to in one walk over a record. A
+// pointer resolves at the first member (or element) its next segment
+// names; below a value no pointer is pending in, the value is skipped in
+// place, and once none is pending anywhere the walk stops.
+class FieldScanner {
+public:
+  explicit FieldScanner(std::vector<const JsonPointer *> fields)
+      : fields_(std::move(fields)), tokens_(fields_.size()) {}
+  // Raw text of each field in the record at cur, nullopt where missing.
+  const std::vector<std::optional<std::string_view>> &
+  scan(const char *cur, const char *end);
+
+private:
+  static constexpr uint32_t kClaimed = UINT32_MAX;
+  bool names(uint32_t field, size_t depth, std::string_view key) const {
+    return fields_[field]->tokens()[depth] == key;
+  }
+  bool names(uint32_t field, size_t depth, size_t index) const {
+    size_t wanted = 0;
+    return parseIndex(fields_[field]->tokens()[depth], wanted) &&
+           wanted == index;
+  }
+  const char *walk(const char *cur, const char *end, size_t depth,
+                   size_t first, bool whole);
+  template <typename Name>
+  const char *member(const char *cur, const char *end, size_t depth,
+                     size_t first, size_t &pending, bool whole,
+                     const Name &name);
+
+  std::vector<const JsonPointer *> fields_;
+  std::vector<std::optional<std::string_view>> tokens_;
+  // Fields pending inside the values being walked, outermost first.
+  std::vector<uint32_t> open_;
+  // Fields that resolve to the member being walked.
+  std::vector<uint32_t> ends_;
+  std::string key_;
+};
+
+const std::vector<std::optional<std::string_view>> &
+FieldScanner::scan(const char *cur, const char *end) {
+  open_.clear();
+  ends_.clear();
+  for (uint32_t field = 0; field < fields_.size(); field++) {
+    tokens_[field].reset();
+    (fields_[field]->tokens().empty() ? ends_ : open_).push_back(field);
+  }
+  cur = skipSpace(cur, end);
+  const char *value_end = nullptr;
+  if (!open_.empty())
+    value_end = walk(cur, end, 0, 0, !ends_.empty());
+  else if (!ends_.empty())
+    value_end = detail::skipValue(cur, end);
+  for (uint32_t field : ends_)
+    tokens_[field] = std::string_view(cur, value_end - cur);
+  return tokens_;
+}
+
+// The value at cur with open_[first, end) pending in it. Returns its end,
+// or nullptr once nothing is pending unless `whole` asks for the end.
+const char *FieldScanner::walk(const char *cur, const char *end, size_t depth,
+                               size_t first, bool whole) {
+  size_t pending = open_.size() - first;
+  if (cur == end || (*cur != '{' && *cur != '['))
+    return whole ? detail::skipValue(cur, end) : nullptr;
+  bool object = *cur == '{';
+  char close = object ? '}' : ']';
+  cur = skipSpace(cur + 1, end);
+  if (cur != end && *cur == close)
+    return cur + 1;
+  for (size_t index = 0;; index++) {
+    if (object) {
+      if (cur == end || *cur != '"')
+        throw Exception(Exception::ParseError::BAD_KEY);
+      bool escaped = false;
+      const char *key_end = skipString(cur, end, escaped);
+      std::string_view key(cur + 1, key_end - cur - 2);
+      if (escaped && pending)
+        key = key_ = detail::unescapeJson(key);
+      cur = skipSpace(key_end, end);
+      if (cur == end || *cur != ':')
+        throw Exception(Exception::ParseError::MISS_COLON);
+      cur = skipSpace(cur + 1, end);
+      cur = member(cur, end, depth, first, pending, whole, key);
+    } else {
+      cur = member(cur, end, depth, first, pending, whole, index);
+    }
+    if (!cur)
+      return nullptr;
+    cur = skipSpace(cur, end);
+    if (cur != end && *cur == close)
+      return cur + 1;
+    if (cur == end || *cur != ',')
+      throw Exception(object ? Exception::ParseError::LACK_COMMA_OR_BRACE
+                             : Exception::ParseError::LACK_COMMA_OR_BRACKET);
+    cur = skipSpace(cur + 1, end);
+  }
+}
+
+// The member or element at cur, named `name`: claims the pending fields
+// whose next segment is `name`, resolves those that end here and walks the
+// value for the rest. Returns the end of the value, or nullptr as walk().
+template <typename Name>
+const char *FieldScanner::member(const char *cur, const char *end,
+                                 size_t depth, size_t first, size_t &pending,
+                                 bool whole, const Name &name) {
+  size_t last = open_.size();
+  size_t ends = ends_.size();
+  for (size_t idx = first; pending && idx < last; idx++) {
+    uint32_t field = open_[idx];
+    if (field == kClaimed || !names(field, depth, name))
+      continue;
+    open_[idx] = kClaimed;
+    pending--;
+    if (fields_[field]->tokens().size() == depth + 1)
+      ends_.push_back(field);
+    else
+      open_.push_back(field);
+  }
+  bool resolves = ends_.size() > ends;
+  whole = whole || pending || resolves;
+  const char *value_end =
+      open_.size() > last ? walk(cur, end, depth + 1, last, whole)
+      : whole             ? detail::skipValue(cur, end)
+                          : nullptr;
+  for (size_t idx = ends; idx < ends_.size(); idx++)
+    tokens_[ends_[idx]] = std::string_view(cur, value_end - cur);
+  ends_.resize(ends);
+  open_.resize(last);
+  return value_end;
+}
+} // namespace
+
+static std::optional<double> tokenNumber(std::string_view token) {
+  if (token.empty() || (token[0] != '-' && (token[0] < '0' || token[0] > '9')))
+    return std::nullopt;
+  const char *last = token.data() + token.size();
+  double num = 0;
+  auto [ptr, ec] = std::from_chars(token.data(), last, num);
+  if (ptr != last)
+    return std::nullopt;
+  if (ec == std::errc::result_out_of_range)
+    return detail::decodeDouble(token.data(), last);
+  return num;
+}
+
+// The decoded content of a string token, unescaped into scratch if needed.
+static std::string_view tokenString(std::string_view token,
+                                    std::string &scratch) {
+  std::string_view inner = token.substr(1, token.size() - 2);
+  if (inner.find('\\') == std::string_view::npos)
+    return inner;
+  scratch = detail::unescapeJson(inner);
+  return scratch;
+}
+
+JsonPointer::JsonPointer(std::string_view text) {
+  if (text.empty())
+    return;
+  if (text[0] != '/')
+    throw std::invalid_argument("smalljson::JsonPointer: missing '/'");
+  size_t pos = 1;
+  while (true) {
+    size_t next = std::min(text.find('/', pos), text.size());
+    std::string token;
+    for (size_t idx = pos; idx < next; idx++) {
+      if (text[idx] != '~') {
+        token += text[idx];
+      } else if (idx + 1 < next && (text[idx + 1] == '0' || text[idx + 1] == '1')) {
+        token += text[++idx] == '0' ? '~' : '/';
+      } else {
+        throw std::invalid_argument("smalljson::JsonPointer: bad escape");
+      }
+    }
+    tokens_.push_back(std::move(token));
+    if (next == text.size())
       break;
+    pos = next + 1;
+  }
+}
+
+const Value *JsonPointer::find(const Value &root) const noexcept {
+  const Value *value = &root;
+  for (auto &token : tokens_) {
+    if (auto obj = value->get_if<Object>()) {
+      auto iter = obj->find(token);
+      if (iter == obj->end())
+        return nullptr;
+      value = &iter->second;
+    } else if (auto arr = value->get_if<Array>()) {
+      size_t index = 0;
+      if (!parseIndex(token, index) || index >= arr->size())
+        return nullptr;
+      value = &arr->at(index);
+    } else {
+      return nullptr;
     }
-    unescapeStr.replace(idx, 2, replaceStr[replaceIdx]);
   }
-  return unescapeStr;
+  return value;
+}
+
+Query &Query::where(std::string_view pointer, Op op, const Value &operand) {
+  Predicate pred{JsonPointer(pointer), op, operand.type(), {}, 0};
+  switch (operand.type()) {
+  case Value::ValueType::String:
+    pred.text = operand.to_string();
+    break;
+  case Value::ValueType::Number:
+    pred.number = operand.to_double();
+    break;
+  case Value::ValueType::Null:
+  case Value::ValueType::Boolean:
+    pred.text = operand.to_print();
+    break;
+  default:
+    throw std::invalid_argument("smalljson::Query: container operand");
+  }
+  predicates_.push_back(std::move(pred));
+  return *this;
+}
+
+Query &Query::group_by(std::string_view pointer) {
+  group_by_.emplace(pointer);
+  return *this;
+}
+
+Query &Query::metric(std::string_view pointer) {
+  metrics_.emplace_back(pointer);
+  return *this;
+}
+
+bool Query::test(const Predicate &pred,
+                 const std::optional<std::string_view> &token,
+                 std::string &scratch) const {
+  if (pred.op == Op::Exists || !token)
+    return pred.op == Op::Exists ? token.has_value() : pred.op == Op::Ne;
+  std::optional<int> cmp;
+  if (pred.type == Value::ValueType::String) {
+    if ((*token)[0] == '"')
+      cmp = tokenString(*token, scratch).compare(pred.text);
+  } else if (pred.type == Value::ValueType::Number) {
+    if (auto num = tokenNumber(*token))
+      cmp = *num < pred.number ? -1 : *num > pred.number ? 1 : 0;
+  } else if (pred.op == Op::Eq || pred.op == Op::Ne) {
+    cmp = *token == pred.text ? 0 : 1;
+  }
+  switch (pred.op) {
+  case Op::Eq:
+    return cmp == 0;
+  case Op::Ne:
+    return cmp != 0;
+  case Op::Lt:
+    return cmp && *cmp < 0;
+  case Op::Le:
+    return cmp && *cmp <= 0;
+  case Op::Gt:
+    return cmp && *cmp > 0;
+  default:
+    return cmp && *cmp >= 0;
+  }
+}
+
+void Query::runChunk(std::string_view chunk, size_t base,
+                     result_t &groups) const {
+  // Every field a record is tested or aggregated on, read in one walk:
+  // the predicates', then group_by's, then the metrics'.
+  std::vector<const JsonPointer *> fields;
+  for (auto &pred : predicates_)
+    fields.push_back(&pred.pointer);
+  if (group_by_)
+    fields.push_back(&*group_by_);
+  for (auto &metric : metrics_)
+    fields.push_back(&metric);
+  FieldScanner scanner(std::move(fields));
+  std::string scratch, key_scratch;
+  const char *cur = chunk.data();
+  const char *end = cur + chunk.size();
+  while (cur != end) {
+    const char *line_end =
+        static_cast<const char *>(std::memchr(cur, '\n', end - cur));
+    if (!line_end)
+      line_end = end;
+    const char *first = skipSpace(cur, line_end);
+    const char *line = cur;
+    cur = line_end == end ? end : line_end + 1;
+    if (first == line_end)
+      continue;
+    try {
+      aggregate(scanner.scan(line, line_end).data(), groups, scratch,
+                key_scratch);
+    } catch (Exception &err) {
+      err.offset_ = line - chunk.data() + base;
+      throw;
+    }
+  }
+}
+
+// Insignificant whitespace dropped from a container's raw text, so the
+// same value spelled with and without spaces groups together.
+static void compactToken(std::string_view token, std::string &out) {
+  out.clear();
+  bool quoted = false;
+  for (size_t idx = 0; idx < token.size(); idx++) {
+    char ch = token[idx];
+    if (quoted && ch == '\\') {
+      out += ch;
+      ch = token[++idx];
+    } else if (ch == '"') {
+      quoted = !quoted;
+    } else if (!quoted &&
+               (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n')) {
+      continue;
+    }
+    out += ch;
+  }
+}
+
+void Query::aggregate(const std::optional<std::string_view> *tokens,
+                      result_t &groups, std::string &scratch,
+                      std::string &key_scratch) const {
+  for (auto &pred : predicates_) {
+    if (!test(pred, *tokens++, scratch))
+      return;
+  }
+  std::string_view key;
+  if (group_by_) {
+    const auto &token = *tokens++;
+    key = token ? *token : "null";
+    if (!key.empty() && key[0] == '"' &&
+        key.find('\\') != std::string_view::npos) {
+      // Spell escaped strings one way, so "a\/b" and "a/b" group together.
+      key_scratch = "\"";
+      detail::appendEscaped(key_scratch, tokenString(key, scratch));
+      key_scratch += '"';
+      key = key_scratch;
+    } else if ((key[0] == '{' || key[0] == '[') &&
+               key.find_first_of(" \t\r") != std::string_view::npos) {
+      compactToken(key, key_scratch);
+      key = key_scratch;
+    }
+  }
+  auto iter = groups.find(key);
+  if (iter == groups.end()) {
+    iter = groups.emplace(std::string(key), Group()).first;
+    iter->second.metrics.resize(metrics_.size());
+  }
+  iter->second.count++;
+  for (size_t idx = 0; idx < metrics_.size(); idx++) {
+    const auto &token = tokens[idx];
+    auto num = token ? tokenNumber(*token) : std::nullopt;
+    if (!num)
+      continue;
+    Stats &stats = iter->second.metrics[idx];
+    stats.count++;
+    stats.sum += *num;
+    stats.min = std::min(stats.min, *num);
+    stats.max = std::max(stats.max, *num);
+  }
+}
+
+void detail::runParts(unsigned parts,
+                      const std::function<void(unsigned)> &work) {
+  std::vector<std::exception_ptr> errors(parts);
+  auto guarded = [&](unsigned part) {
+    try {
+      work(part);
+    } catch (...) {
+      errors[part] = std::current_exception();
+    }
+  };
+  std::vector<std::thread> workers;
+  unsigned spawned = 1;
+  try {
+    for (; spawned < parts; spawned++)
+      workers.emplace_back(guarded, spawned);
+  } catch (const std::system_error &) {
+    // Out of threads: the parts left over run here.
+  }
+  if (parts > 0)
+    guarded(0);
+  for (unsigned part = spawned; part < parts; part++)
+    guarded(part);
+  for (auto &worker : workers)
+    worker.join();
+  for (auto &error : errors) {
+    if (error)
+      std::rethrow_exception(error);
+  }
+}
+
+Query::result_t Query::run(std::string_view ndjson, unsigned threads) const {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = static_cast<unsigned>(
+      std::max<size_t>(1, std::min<size_t>(threads, ndjson.size() >> 16)));
+  std::vector<std::string_view> chunks;
+  size_t first = 0;
+  for (unsigned part = 1; part <= threads; part++) {
+    size_t last = part == threads ? ndjson.size()
+                                  : ndjson.find('\n', ndjson.size() * part /
+                                                          threads);
+    last = std::min(last == std::string_view::npos ? ndjson.size() : last + 1,
+                    ndjson.size());
+    if (last > first)
+      chunks.push_back(ndjson.substr(first, last - first));
+    first = std::max(first, last);
+  }
+  std::vector<result_t> partials(chunks.size());
+  detail::runParts(static_cast<unsigned>(chunks.size()), [&](unsigned idx) {
+    runChunk(chunks[idx], chunks[idx].data() - ndjson.data(), partials[idx]);
+  });
+  result_t result;
+  for (auto &partial : partials) {
+    for (auto &[key, group] : partial) {
+      auto [iter, inserted] = result.try_emplace(key, std::move(group));
+      if (inserted)
+        continue;
+      iter->second.count += group.count;
+      for (size_t idx = 0; idx < metrics_.size(); idx++) {
+        Stats &into = iter->second.metrics[idx];
+        const Stats &from = group.metrics[idx];
+        into.count += from.count;
+        into.sum += from.sum;
+        into.min = std::min(into.min, from.min);
+        into.max = std::max(into.max, from.max);
+      }
+    }
+  }
+  return result;
+}
+
+Value Parser::parse(const std::string &json_data, NumberMode mode,
+                    DuplicateKeys keys) {
+  if (mode == NumberMode::Lossless)
+    return parseWith<NumberMode::Lossless>(json_data, keys);
+  return parseWith<NumberMode::Binary>(json_data, keys);
+}
+
+Document Document::parse(std::string json_data, DuplicateKeys keys) {
+  switch (keys) {
+  case DuplicateKeys::FirstWins:
+    return parse<RuntimeOptions<NumberMode::Binary, DuplicateKeys::FirstWins,
+                                true>>(std::move(json_data));
+  case DuplicateKeys::Reject:
+    return parse<RuntimeOptions<NumberMode::Binary, DuplicateKeys::Reject,
+                                true>>(std::move(json_data));
+  default:
+    return parse<RuntimeOptions<NumberMode::Binary, DuplicateKeys::LastWins,
+                                true>>(std::move(json_data));
+  }
+}
+
+Document Document::parse(std::string json_data, const Arena::Options &arena,
+                         DuplicateKeys keys) {
+  switch (keys) {
+  case DuplicateKeys::FirstWins:
+    return parse<RuntimeOptions<NumberMode::Binary, DuplicateKeys::FirstWins,
+                                true>>(std::move(json_data), arena);
+  case DuplicateKeys::Reject:
+    return parse<RuntimeOptions<NumberMode::Binary, DuplicateKeys::Reject,
+                                true>>(std::move(json_data), arena);
+  default:
+    return parse<RuntimeOptions<NumberMode::Binary, DuplicateKeys::LastWins,
+                                true>>(std::move(json_data), arena);
+  }
+}
+
+Exception::Location Exception::locate(std::string_view input,
+                                      size_t context) const {
+  size_t pos = std::min(offset_, input.size());
+  size_t line_start = input.substr(0, pos).rfind('\n');
+  line_start = line_start == std::string_view::npos ? 0 : line_start + 1;
+  size_t line_end = std::min(input.find('\n', pos), input.size());
+  if (line_end > pos && input[line_end - 1] == '\r')
+    line_end--;
+  size_t first = pos - std::min(pos - line_start, context);
+  size_t last = pos + std::min(line_end - pos, context + 1);
+  Location loc;
+  loc.line = 1 + std::count(input.begin(), input.begin() + pos, '\n');
+  loc.column = pos - line_start + 1;
+  loc.snippet = std::string(input.substr(first, last - first));
+  loc.caret = pos - first;
+  return loc;
 }
 
 const char *Exception::errorToStr() const {
@@ -517,6 +2710,14 @@ const char *Exception::errorToStr() const {
     return "bad number";
   case ParseError::BAD_TYPE:
     return "bad type";
+  case ParseError::DUPLICATE_KEY:
+    return "duplicate key";
+  case ParseError::BAD_COMMENT:
+    return "bad comment";
+  case ParseError::BAD_UTF8:
+    return "bad utf-8";
+  case ParseError::TOO_DEEP:
+    return "too deep";
   default:
     return "other error";
   }
@@ -1,21 +1,346 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <utility>
 #include <variant>
 #include <vector>
 
 namespace smalljson {
 class Array;
 class Object;
+class Cursor;
+
+// FNV-1a over the raw key bytes, usable at compile time.
+constexpr uint32_t hashKey(std::string_view key,
+                           uint32_t seed = 0x811c9dc5u) noexcept {
+  uint32_t hash = seed;
+  for (char ch : key) {
+    hash ^= static_cast<unsigned char>(ch);
+    hash *= 0x01000193u;
+  }
+  return hash;
+}
+
+// Object key with its hash computed up front. Literal keys ("id"_key, or
+// key<"id"> in C++20) are hashed at compile time.
+struct Key {
+  constexpr explicit Key(std::string_view key) noexcept
+      : name(key), hash(hashKey(key)) {}
+  std::string_view name;
+  uint32_t hash;
+};
+
+namespace literals {
+constexpr Key operator""_key(const char *str, size_t len) noexcept {
+  return Key(std::string_view(str, len));
+}
+} // namespace literals
+
+#if defined(__cpp_nontype_template_args) &&                                    \
+    __cpp_nontype_template_args >= 201911L
+template <size_t N> struct FixedString {
+  char data[N]{};
+  constexpr FixedString(const char (&str)[N]) {
+    for (size_t idx = 0; idx < N; idx++)
+      data[idx] = str[idx];
+  }
+  constexpr std::string_view view() const { return {data, N - 1}; }
+};
+
+template <FixedString Name> inline constexpr Key key{Name.view()};
+#endif
+
+// Bump allocator for parsed trees. Memory is mapped from the OS in large
+// chunks, optionally backed by huge pages and bound to the NUMA node of
+// the allocating thread, and returned all at once when the Arena is
+// destroyed. An Arena is used by one thread at a time; see ArenaScope.
+class Arena {
+public:
+  struct Options {
+    // Bytes per chunk, rounded up to a multiple of 2 MiB.
+    size_t chunk_size = size_t(8) << 20;
+    // madvise(MADV_HUGEPAGE): ask for transparent huge pages.
+    bool transparent_huge_pages = true;
+    // MAP_HUGETLB from the reserved pool, falling back to normal pages
+    // when it is exhausted.
+    bool hugetlb = false;
+    // mbind each chunk to the NUMA node the allocating thread runs on.
+    bool numa_local = true;
+  };
+
+  Arena() : Arena(Options()) {}
+  explicit Arena(const Options &options);
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  ~Arena();
+  void *allocate(size_t size, size_t align = alignof(std::max_align_t));
+  bool owns(const void *ptr) const noexcept;
+  // Bytes mapped, and bytes handed out, so far.
+  size_t capacity() const noexcept { return capacity_; }
+  size_t used() const noexcept { return used_; }
+
+private:
+  struct Chunk {
+    char *base;
+    size_t size;
+  };
+  char *mapChunk(size_t size);
+
+  Options options_;
+  std::vector<Chunk> chunks_;
+  char *cur_ = nullptr;
+  char *end_ = nullptr;
+  size_t capacity_ = 0;
+  size_t used_ = 0;
+};
+
+// Sends this thread's String, Object and Array allocations to `arena`
+// until the scope ends. Whatever is allocated there must be destroyed
+// before the arena; copying a Value out detaches it.
+class ArenaScope {
+public:
+  explicit ArenaScope(Arena &arena) noexcept;
+  ArenaScope(const ArenaScope &) = delete;
+  ArenaScope &operator=(const ArenaScope &) = delete;
+  ~ArenaScope();
+
+private:
+  Arena *previous_;
+};
+
+namespace detail {
+// The current ArenaScope's arena, or operator new. deallocate() is a
+// no-op for arena memory.
+void *allocate(size_t size);
+void deallocate(void *ptr, size_t size) noexcept;
+// The nearest double to the JSON number in [first, last): beyond the
+// largest double that is +-HUGE_VAL, below the smallest +-0.0.
+double decodeDouble(const char *first, const char *last) noexcept;
+
+template <typename T> struct Allocator {
+  typedef T value_type;
+  Allocator() noexcept = default;
+  template <typename U> Allocator(const Allocator<U> &) noexcept {}
+  T *allocate(size_t count) {
+    return static_cast<T *>(detail::allocate(count * sizeof(T)));
+  }
+  void deallocate(T *ptr, size_t count) noexcept {
+    detail::deallocate(ptr, count * sizeof(T));
+  }
+  template <typename U> bool operator==(const Allocator<U> &) const noexcept {
+    return true;
+  }
+  template <typename U> bool operator!=(const Allocator<U> &) const noexcept {
+    return false;
+  }
+};
+} // namespace detail
+
+// Immutable string used for keys and string values. Up to kInlineCapacity
+// bytes live inside the object; longer strings go to the heap. Content is
+// stored decoded, with flags recording whether it needs escaping on output
+// and whether it is valid UTF-8.
+class String {
+public:
+  enum Flag : uint8_t { HasEscapes = 1, ValidUtf8 = 2 };
+  static constexpr size_t kInlineCapacity = 22;
+
+  String() noexcept { setInline(0, ValidUtf8); }
+  String(const char *str) : String(str, std::strlen(str)) {}
+  String(const std::string &str) : String(str.data(), str.size()) {}
+  explicit String(std::string_view str) : String(str.data(), str.size()) {}
+  String(const char *str, size_t len);
+  String(const String &rhs);
+  String(String &&rhs) noexcept {
+    std::memcpy(bytes_, rhs.bytes_, sizeof(bytes_));
+    rhs.setInline(0, ValidUtf8);
+  }
+  String &operator=(const String &rhs);
+  String &operator=(String &&rhs) noexcept;
+  ~String() {
+    if (isHeap())
+      detail::deallocate(heapPtr(), heapSize());
+  }
+
+  const char *data() const noexcept { return isHeap() ? heapPtr() : bytes_; }
+  size_t size() const noexcept {
+    return isHeap() ? heapSize() : static_cast<uint8_t>(bytes_[kTag]);
+  }
+  bool empty() const noexcept { return size() == 0; }
+  const char *begin() const noexcept { return data(); }
+  const char *end() const noexcept { return data() + size(); }
+  char front() const noexcept { return *data(); }
+  std::string_view view() const noexcept { return {data(), size()}; }
+  operator std::string_view() const noexcept { return view(); }
+  std::string str() const { return std::string(data(), size()); }
+  bool has_escapes() const noexcept { return flags() & HasEscapes; }
+  bool valid_utf8() const noexcept { return flags() & ValidUtf8; }
+
+  friend bool operator==(const String &lhs, const String &rhs) noexcept {
+    return lhs.view() == rhs.view();
+  }
+  friend bool operator!=(const String &lhs, const String &rhs) noexcept {
+    return lhs.view() != rhs.view();
+  }
+
+private:
+  static constexpr size_t kFlags = 22;
+  static constexpr size_t kTag = 23;
+  static constexpr uint8_t kHeapTag = 0x80;
+
+  uint8_t flags() const noexcept { return bytes_[kFlags]; }
+  bool isHeap() const noexcept {
+    return static_cast<uint8_t>(bytes_[kTag]) == kHeapTag;
+  }
+  char *heapPtr() const noexcept {
+    char *ptr;
+    std::memcpy(&ptr, bytes_, sizeof(ptr));
+    return ptr;
+  }
+  size_t heapSize() const noexcept {
+    size_t len;
+    std::memcpy(&len, bytes_ + sizeof(char *), sizeof(len));
+    return len;
+  }
+  void setInline(size_t len, uint8_t flags) noexcept {
+    bytes_[kFlags] = static_cast<char>(flags);
+    bytes_[kTag] = static_cast<char>(len);
+  }
+  void assign(const char *str, size_t len, uint8_t flags);
+
+  alignas(char *) char bytes_[24];
+};
+
+// Transparent ordering so Object lookups by string_view or std::string do
+// not build a String.
+struct KeyLess {
+  typedef void is_transparent;
+  bool operator()(std::string_view lhs, std::string_view rhs) const noexcept {
+    return lhs < rhs;
+  }
+};
+
+// How the parser stores numbers. Both keep integers that fit int64_t and
+// decimals of at most 15 significant digits in binary, which round-trips
+// them exactly. Other numbers become the nearest double in Binary mode and
+// keep their decimal text in Lossless mode.
+enum class NumberMode { Binary, Lossless };
+
+// What the parser does when an object repeats a key: keep the first
+// occurrence, keep the last one (as most JSON parsers do), or throw
+// Exception::ParseError::DUPLICATE_KEY at the repeated key. parse_keys
+// applies the policy only to the members it keeps.
+enum class DuplicateKeys { FirstWins, LastWins, Reject };
+
+// When an Object keeps a hash index over its members: from
+// Object::kIndexThreshold members on, always, or never (lookups then walk
+// the ordered map).
+enum class HashIndex : uint8_t { Auto, Always, Never };
+
+// Number kept as a span of the input text it was scanned from (see
+// Document), with a hint from the scan. The binary value is decoded on first
+// use and cached; concurrent readers may race to decode, all storing the
+// same bits.
+class Number {
+public:
+  enum Hint : uint8_t { Integer = 0, Fraction = 1, Exponent = 2, Exact = 4 };
+
+  Number(const char *text, uint32_t len, uint8_t hint) noexcept
+      : text_(text), len_(len), hint_(hint), state_(0), cache_(0) {}
+  Number(const Number &rhs) noexcept
+      : text_(rhs.text_), len_(rhs.len_), hint_(rhs.hint_),
+        state_(rhs.state_.load(std::memory_order_acquire)),
+        cache_(rhs.cache_.load(std::memory_order_relaxed)) {}
+  Number &operator=(const Number &rhs) noexcept {
+    text_ = rhs.text_;
+    len_ = rhs.len_;
+    hint_ = rhs.hint_;
+    cache_.store(rhs.cache_.load(std::memory_order_relaxed),
+                 std::memory_order_relaxed);
+    state_.store(rhs.state_.load(std::memory_order_acquire),
+                 std::memory_order_release);
+    return *this;
+  }
+
+  std::string_view text() const noexcept { return {text_, len_}; }
+  Hint kind() const noexcept { return Hint(hint_ & 3); }
+  // Integers that fit int64_t and decimals of at most 15 significant
+  // digits, i.e. numbers whose binary form round-trips.
+  bool exact() const noexcept { return hint_ & Exact; }
+  std::optional<int64_t> to_int64() const noexcept {
+    uint8_t state = decoded();
+    if (state & CachedInt) {
+      int64_t num;
+      uint64_t bits = cache_.load(std::memory_order_relaxed);
+      std::memcpy(&num, &bits, sizeof(num));
+      return num;
+    }
+    return std::nullopt;
+  }
+  double to_double() const noexcept {
+    uint8_t state = decoded();
+    uint64_t bits = cache_.load(std::memory_order_relaxed);
+    if (state & CachedInt) {
+      int64_t num;
+      std::memcpy(&num, &bits, sizeof(num));
+      return static_cast<double>(num);
+    }
+    double num;
+    std::memcpy(&num, &bits, sizeof(num));
+    return num;
+  }
+
+private:
+  enum State : uint8_t { CachedInt = 1, CachedDouble = 2 };
+  uint8_t decoded() const noexcept {
+    uint8_t state = state_.load(std::memory_order_acquire);
+    return state ? state : decode();
+  }
+  uint8_t decode() const noexcept;
+
+  const char *text_;
+  uint32_t len_;
+  uint8_t hint_;
+  mutable std::atomic<uint8_t> state_;
+  mutable std::atomic<uint64_t> cache_;
+};
+
+// Object/Array payloads duplicated so far by copy construction or copy
+// assignment, nested ones included. Always 0 unless the library is built
+// with SMALLJSON_COUNT_COPIES; meant for hunting accidental deep copies.
+uint64_t deep_copy_count() noexcept;
 
 class Value {
 public:
   typedef std::unique_ptr<Object> object_ptr;
   typedef std::unique_ptr<Array> array_ptr;
-  typedef std::variant<std::string, array_ptr, object_ptr> value_t;
+  typedef std::variant<String, array_ptr, object_ptr, int64_t, double, Number>
+      value_t;
 
   enum class ValueType : unsigned {
     Array,
@@ -29,28 +354,29 @@ public:
 public:
   Value() : type_(ValueType::Null) {}
   ~Value() = default;
-  Value(int num) : type_(ValueType::Number), value_data_(std::to_string(num)) {}
+  Value(int num) : type_(ValueType::Number), value_data_(int64_t(num)) {}
   Value(unsigned int num)
-      : type_(ValueType::Number), value_data_(std::to_string(num)) {}
-  Value(long num)
-      : type_(ValueType::Number), value_data_(std::to_string(num)) {}
-  Value(unsigned long num)
-      : type_(ValueType::Number), value_data_(std::to_string(num)) {}
+      : type_(ValueType::Number), value_data_(int64_t(num)) {}
+  Value(long num) : type_(ValueType::Number), value_data_(int64_t(num)) {}
+  Value(unsigned long num) : Value(static_cast<unsigned long long>(num)) {}
   Value(long long num)
-      : type_(ValueType::Number), value_data_(std::to_string(num)) {}
+      : type_(ValueType::Number), value_data_(int64_t(num)) {}
   Value(unsigned long long num)
-      : type_(ValueType::Number), value_data_(std::to_string(num)) {}
-  Value(float num)
-      : type_(ValueType::Number), value_data_(std::to_string(num)) {}
-  Value(double num)
-      : type_(ValueType::Number), value_data_(std::to_string(num)) {}
+      : type_(ValueType::Number),
+        value_data_(num <= uint64_t(INT64_MAX)
+                        ? value_t(int64_t(num))
+                        : value_t(String(std::to_string(num)))) {}
+  Value(float num) : type_(ValueType::Number), value_data_(double(num)) {}
+  Value(double num) : type_(ValueType::Number), value_data_(num) {}
   Value(long double num)
-      : type_(ValueType::Number), value_data_(std::to_string(num)) {}
+      : type_(ValueType::Number), value_data_(double(num)) {}
   Value(bool boolean)
       : type_(ValueType::Boolean), value_data_(boolean ? "true" : "false") {}
-  Value(const std::string &str)
-      : type_(ValueType::String), value_data_(std::move(str)) {}
+  Value(const std::string &str) : type_(ValueType::String), value_data_(str) {}
   Value(const char *str) : type_(ValueType::String), value_data_(str) {}
+  Value(std::string_view str)
+      : type_(ValueType::String), value_data_(String(str)) {}
+  Value(String str) : type_(ValueType::String), value_data_(std::move(str)) {}
   Value(const Value &rhs) : type_(rhs.type_) { deepCopy(rhs.value_data_); }
   Value(Value &&rhs) noexcept = default;
   Value(const Object &obj);
@@ -61,6 +387,7 @@ public:
   Value &operator=(Value &&rhs) = default;
   Value &operator[](size_t idx);
   Value &operator[](const std::string &key);
+  Value &operator[](const Key &key);
 
 public:
   bool isNull() const noexcept { return type_ == ValueType::Null; }
@@ -69,6 +396,16 @@ public:
   bool isObject() const noexcept { return type_ == ValueType::Object; }
   bool isString() const noexcept { return type_ == ValueType::String; }
   bool isBoolean() const noexcept { return type_ == ValueType::Boolean; }
+  bool isDecimal() const noexcept {
+    auto pnum = std::get_if<Number>(&value_data_);
+    return isNumber() && (pnum ? !pnum->exact()
+                               : std::holds_alternative<String>(value_data_));
+  }
+  bool isInteger() const noexcept {
+    auto pnum = std::get_if<Number>(&value_data_);
+    return std::holds_alternative<int64_t>(value_data_) ||
+           (pnum && pnum->kind() == Number::Integer && pnum->to_int64());
+  }
   ValueType type() const noexcept { return type_; }
   bool empty() const noexcept { return isNull(); }
   bool to_boolean() const;
@@ -76,7 +413,20 @@ public:
   float to_float() const;
   double to_double() const;
   const std::string to_print() const;
+  void to_print(std::string &out) const;
   const std::string to_string() const;
+  // Bytes allocated beyond sizeof(Value): child containers with their map
+  // nodes, vector capacity and hash index, and strings too long to inline.
+  // Map nodes are counted as the entry plus four words of tree links.
+  size_t memory_usage() const noexcept;
+  // Consistent with operator==.
+  size_t hash() const noexcept;
+  // Deep comparison. Numbers compare by value: exact integers as int64_t,
+  // the rest as double, so 1, 1.0 and 1e0 are equal.
+  friend bool operator==(const Value &lhs, const Value &rhs) noexcept;
+  friend bool operator!=(const Value &lhs, const Value &rhs) noexcept {
+    return !(lhs == rhs);
+  }
   Array &to_array();
   const Array &to_array() const;
   Object &to_object();
@@ -85,6 +435,18 @@ public:
   Value &at(const std::string &key);
   const Value &at(size_t idx) const;
   const Value &at(const std::string &key) const;
+  Value &at(const Key &key);
+  const Value &at(const Key &key) const;
+
+  // Non-throwing typed access. Integer targets must be hit exactly (no
+  // rounding of 1.5, no overflow); floating targets take the nearest value.
+  // Strings are viewed decoded. Array and Object are returned as pointers,
+  // nullptr on mismatch, as get_if does. get_if<int64_t>/get_if<double>
+  // expose numbers stored in that binary form, get_if<Number> numbers
+  // parsed lazily by a Document.
+  template <typename T> auto get() const noexcept;
+  template <typename T> T *get_if() noexcept;
+  template <typename T> const T *get_if() const noexcept;
 
   template <typename... Args>
   Value(ValueType type, Args &&...args)
@@ -103,24 +465,30 @@ private:
 
 class Object {
 public:
-  typedef std::map<std::string, Value> object_t;
+  typedef std::map<String, Value, KeyLess,
+                   detail::Allocator<std::pair<const String, Value>>>
+      object_t;
   typedef object_t::iterator iterator;
   typedef object_t::const_iterator const_iterator;
   typedef object_t::reverse_iterator reverse_iterator;
   typedef object_t::const_reverse_iterator const_reverse_iterator;
 
 public:
+  static void *operator new(size_t size) { return detail::allocate(size); }
+  static void operator delete(void *ptr, size_t size) noexcept {
+    detail::deallocate(ptr, size);
+  }
   Object() = default;
-  Object(const Object &rhs) = default;
+  Object(const Object &rhs);
   Object(Object &&rhs) noexcept = default;
-  Object(const object_t &object_data) : object_data_(object_data) {}
-  Object(object_t &&object_data) : object_data_(std::move(object_data)) {}
-  Object(std::initializer_list<object_t::value_type> init_list)
-      : object_data_(init_list) {}
-  Object &operator=(const Object &rhs) = default;
+  Object(const object_t &object_data);
+  Object(object_t &&object_data, HashIndex hash_index = HashIndex::Auto);
+  Object(std::initializer_list<object_t::value_type> init_list);
+  Object &operator=(const Object &rhs);
   Object &operator=(Object &&rhs) = default;
   Value &operator[](const std::string &key);
   Value &operator[](std::string &&key);
+  Value &operator[](const Key &key);
   iterator begin() noexcept { return object_data_.begin(); }
   iterator end() noexcept { return object_data_.end(); }
   const_iterator begin() const noexcept { return object_data_.begin(); }
@@ -137,57 +505,116 @@ public:
     return object_data_.crbegin();
   }
   const_reverse_iterator crend() const noexcept { return object_data_.crend(); }
-  iterator find(const std::string &key) { return object_data_.find(key); }
-  const_iterator find(const std::string &key) const {
-    return object_data_.find(key);
-  }
-  object_t::mapped_type &at(const std::string &key) {
-    return object_data_.at(key);
-  }
-  const object_t::mapped_type &at(const std::string &key) const {
-    return object_data_.at(key);
-  }
-  object_t::size_type erase(const std::string &key) {
-    return object_data_.erase(key);
-  }
-  iterator erase(iterator pos) { return object_data_.erase(pos); }
-  const_iterator erase(const_iterator pos) { return object_data_.erase(pos); }
-  iterator erase(const_iterator first, const_iterator last) {
-    return object_data_.erase(first, last);
-  }
+  iterator find(const std::string &key);
+  const_iterator find(const std::string &key) const;
+  iterator find(const Key &key);
+  const_iterator find(const Key &key) const;
+  object_t::mapped_type &at(const std::string &key);
+  const object_t::mapped_type &at(const std::string &key) const;
+  object_t::mapped_type &at(const Key &key);
+  const object_t::mapped_type &at(const Key &key) const;
+  object_t::size_type erase(const std::string &key);
+  iterator erase(iterator pos) { return erase(const_iterator(pos)); }
+  iterator erase(const_iterator pos);
+  iterator erase(const_iterator first, const_iterator last);
   bool empty() const noexcept { return object_data_.empty(); }
   size_t size() const noexcept { return object_data_.size(); }
-  void clear() noexcept { object_data_.clear(); }
+  HashIndex hash_index() const noexcept { return hash_index_; }
+  void set_hash_index(HashIndex hash_index);
+  void clear() noexcept {
+    dropIndex();
+    object_data_.clear();
+  }
   template <typename... Args> decltype(auto) emplace(Args &&...args) {
     static_assert(std::is_constructible<object_t::value_type, Args...>::value,
                   "object params error");
-    return object_data_.emplace(std::forward<Args>(args)...);
+    auto result = object_data_.emplace(std::forward<Args>(args)...);
+    if (result.second && !ctrl_.empty())
+      indexInsert(result.first);
+    return result;
+  }
+  // Constructs the Value from args only when key is absent; args are left
+  // untouched otherwise.
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(String key, Args &&...args) {
+    static_assert(std::is_constructible<Value, Args...>::value,
+                  "object params error");
+    auto result =
+        object_data_.try_emplace(std::move(key), std::forward<Args>(args)...);
+    if (result.second && !ctrl_.empty())
+      indexInsert(result.first);
+    return result;
+  }
+  template <typename V>
+  std::pair<iterator, bool> insert_or_assign(String key, V &&value) {
+    auto result =
+        object_data_.insert_or_assign(std::move(key), std::forward<V>(value));
+    if (result.second && !ctrl_.empty())
+      indexInsert(result.first);
+    return result;
   }
 
 public:
   const std::string to_print() const;
+  void to_print(std::string &out) const;
+  // Bytes allocated beyond sizeof(Object), as Value::memory_usage().
+  size_t memory_usage() const noexcept;
+
+public:
+  // Where the hash index starts to beat the map, see `smalljson_bench lookup`.
+  static constexpr size_t kIndexThreshold = 16;
 
 private:
+  // Swiss-table style index from key hash to map entry: one control byte
+  // per slot (kEmpty, or the top 7 bits of the hash) beside the slot array,
+  // probed a group of 16 bytes at a time. Erasing leaves a kDeleted
+  // tombstone, which probes step over and inserts reuse; once tombstones
+  // fill an eighth of the slots the index is rebuilt.
+  static constexpr size_t kGroupSize = 16;
+  static constexpr uint8_t kEmpty = 0x80;
+  static constexpr uint8_t kDeleted = 0xfe;
+  const iterator *findSlot(const Key &key) const;
+  size_t indexThreshold() const noexcept;
+  void ensureIndex();
+  void buildIndex();
+  void indexInsert(iterator entry);
+  void placeEntry(iterator entry, uint32_t hash);
+  void indexErase(const_iterator entry);
+  void compactIndex();
+  void dropIndex() noexcept {
+    std::vector<uint8_t>().swap(ctrl_);
+    std::vector<iterator>().swap(slots_);
+    deleted_ = 0;
+  }
+
   object_t object_data_;
+  std::vector<uint8_t> ctrl_;
+  std::vector<iterator> slots_;
+  size_t deleted_ = 0;
+  HashIndex hash_index_ = HashIndex::Auto;
 };
 
 class Array {
 public:
-  typedef std::vector<Value> array_t;
+  typedef std::vector<Value, detail::Allocator<Value>> array_t;
   typedef array_t::iterator iterator;
   typedef array_t::const_iterator const_iterator;
   typedef array_t::reverse_iterator reverse_iterator;
   typedef array_t::const_reverse_iterator const_reverse_iterator;
 
 public:
+  static void *operator new(size_t size) { return detail::allocate(size); }
+  static void operator delete(void *ptr, size_t size) noexcept {
+    detail::deallocate(ptr, size);
+  }
   Array() = default;
-  Array(const Array &rhs) = default;
+  Array(const Array &rhs);
   Array(Array &&rhs) noexcept = default;
-  Array(const array_t &array_data) : array_data_(array_data) {}
+  Array(const array_t &array_data);
   Array(array_t &&array_data) : array_data_(std::move(array_data)) {}
   Array(std::initializer_list<array_t::value_type> init_list)
       : array_data_(init_list) {}
-  Array &operator=(const Array &rhs) = default;
+  Array &operator=(const Array &rhs);
   Array &operator=(Array &&rhs) = default;
   Value &operator[](size_t idx);
   iterator begin() noexcept { return array_data_.begin(); }
@@ -216,6 +643,9 @@ public:
   size_t size() const noexcept { return array_data_.size(); }
   bool empty() const noexcept { return array_data_.empty(); }
   void clear() noexcept { array_data_.clear(); }
+  void reserve(size_t size) { array_data_.reserve(size); }
+  void push_back(const Value &value) { array_data_.push_back(value); }
+  void push_back(Value &&value) { array_data_.push_back(std::move(value)); }
   template <typename... Args> decltype(auto) emplace_back(Args &&...args) {
     static_assert(std::is_constructible<array_t::value_type, Args...>::value,
                   "array parames error");
@@ -224,35 +654,689 @@ public:
 
 public:
   const std::string to_print() const;
+  void to_print(std::string &out) const;
+  // Bytes allocated beyond sizeof(Array), as Value::memory_usage().
+  size_t memory_usage() const noexcept;
 
 private:
   array_t array_data_;
 };
 
-class Parser {
+template <typename T> T *Value::get_if() noexcept {
+  return const_cast<T *>(static_cast<const Value *>(this)->get_if<T>());
+}
+
+template <typename T> const T *Value::get_if() const noexcept {
+  if constexpr (std::is_same_v<T, Array>) {
+    auto pval = std::get_if<array_ptr>(&value_data_);
+    return isArray() && pval ? pval->get() : nullptr;
+  } else if constexpr (std::is_same_v<T, Object>) {
+    auto pval = std::get_if<object_ptr>(&value_data_);
+    return isObject() && pval ? pval->get() : nullptr;
+  } else if constexpr (std::is_same_v<T, String>) {
+    return isString() ? std::get_if<String>(&value_data_) : nullptr;
+  } else if constexpr (std::is_same_v<T, int64_t> ||
+                       std::is_same_v<T, double> ||
+                       std::is_same_v<T, Number>) {
+    return std::get_if<T>(&value_data_);
+  } else {
+    static_assert(sizeof(T) == 0, "get_if type error");
+  }
+}
+
+template <typename T> auto Value::get() const noexcept {
+  if constexpr (std::is_same_v<T, Array> || std::is_same_v<T, Object>) {
+    return get_if<T>();
+  } else if constexpr (std::is_same_v<T, bool>) {
+    auto pval = std::get_if<String>(&value_data_);
+    return isBoolean() && pval ? std::optional<bool>(pval->front() == 't')
+                               : std::nullopt;
+  } else if constexpr (std::is_same_v<T, std::string_view>) {
+    auto pval = std::get_if<String>(&value_data_);
+    return isString() && pval ? std::optional<std::string_view>(pval->view())
+                              : std::nullopt;
+  } else if constexpr (std::is_arithmetic_v<T>) {
+    typedef std::numeric_limits<T> limits;
+    auto fromInt = [](int64_t num) {
+      std::optional<T> result;
+      if constexpr (std::is_floating_point_v<T>) {
+        result = static_cast<T>(num);
+      } else if (num >= 0 ? uint64_t(num) <= uint64_t(limits::max())
+                          : num >= int64_t(limits::min())) {
+        result = static_cast<T>(num);
+      }
+      return result;
+    };
+    auto fromDouble = [](double num) {
+      std::optional<T> result;
+      if constexpr (std::is_floating_point_v<T>) {
+        result = static_cast<T>(num);
+      } else if (std::trunc(num) == num && num >= double(limits::min()) &&
+                 num < 2.0 * double(limits::max() / 2 + 1)) {
+        result = static_cast<T>(num);
+      }
+      return result;
+    };
+    std::optional<T> result;
+    if (auto pint = std::get_if<int64_t>(&value_data_)) {
+      result = fromInt(*pint);
+    } else if (auto pdbl = std::get_if<double>(&value_data_)) {
+      result = fromDouble(*pdbl);
+    } else if (auto pnum = std::get_if<Number>(&value_data_)) {
+      auto num = pnum->to_int64();
+      result = num ? fromInt(*num) : fromDouble(pnum->to_double());
+      if constexpr (std::is_integral_v<T>) {
+        // Integers past int64_t, read exactly from the text as a copied
+        // Value reads its String.
+        if (!num && pnum->kind() == Number::Integer) {
+          std::string_view text = pnum->text();
+          T exact{};
+          auto [ptr, ec] =
+              std::from_chars(text.data(), text.data() + text.size(), exact);
+          result = ec == std::errc() && ptr == text.data() + text.size()
+                       ? std::optional<T>(exact)
+                       : std::nullopt;
+        }
+      }
+    } else if (auto pval = std::get_if<String>(&value_data_);
+               pval && isNumber()) {
+      const char *last = pval->data() + pval->size();
+      T num{};
+      auto [ptr, ec] = std::from_chars(pval->data(), last, num);
+      if (ec == std::errc() && ptr == last)
+        result = num;
+      else if constexpr (std::is_floating_point_v<T>)
+        result = static_cast<T>(detail::decodeDouble(pval->data(), last));
+    }
+    return result;
+  } else {
+    static_assert(sizeof(T) == 0, "get type error");
+  }
+}
+
+// Dispatches on the value's kind with one switch, calling vis with
+// nullptr, bool, int64_t or double (decimals kept in Lossless mode go as
+// the nearest double), std::string_view, Array or Object.
+template <typename Visitor>
+decltype(auto) visit(Visitor &&vis, const Value &value) {
+  using result_t = std::invoke_result_t<Visitor, std::nullptr_t>;
+  switch (value.type()) {
+  case Value::ValueType::Null:
+    return static_cast<result_t>(vis(nullptr));
+  case Value::ValueType::Boolean:
+    return static_cast<result_t>(vis(*value.get<bool>()));
+  case Value::ValueType::Number:
+    if (value.isInteger())
+      return static_cast<result_t>(vis(*value.get<int64_t>()));
+    return static_cast<result_t>(vis(value.get<double>().value_or(0.0)));
+  case Value::ValueType::String:
+    return static_cast<result_t>(vis(*value.get<std::string_view>()));
+  case Value::ValueType::Array:
+    return static_cast<result_t>(vis(*value.get_if<Array>()));
+  default:
+    return static_cast<result_t>(vis(*value.get_if<Object>()));
+  }
+}
+
+// Pre-order traversal with an explicit stack, so depth is bounded by memory
+// rather than the call stack. fn(value, depth) may return false to skip the
+// value's children.
+template <typename Fn> void walk(const Value &root, Fn &&fn) {
+  std::vector<std::pair<const Value *, size_t>> stack{{&root, 0}};
+  while (!stack.empty()) {
+    auto [value, depth] = stack.back();
+    stack.pop_back();
+    if constexpr (std::is_same_v<std::invoke_result_t<Fn, const Value &,
+                                                      size_t>,
+                                 bool>) {
+      if (!fn(*value, depth))
+        continue;
+    } else {
+      fn(*value, depth);
+    }
+    if (auto arr = value->get_if<Array>()) {
+      for (auto iter = arr->rbegin(); iter != arr->rend(); ++iter)
+        stack.emplace_back(&*iter, depth + 1);
+    } else if (auto obj = value->get_if<Object>()) {
+      for (auto iter = obj->rbegin(); iter != obj->rend(); ++iter)
+        stack.emplace_back(&iter->second, depth + 1);
+    }
+  }
+}
+
+// Streaming construction of a document:
+//
+//   smalljson::Builder b;
+//   b.begin_object().key("id").value(7).key("tags").begin_array();
+//   b.value("a").value("b").end_array().end_object();
+//   std::string text = b.to_print(); // or: smalljson::Value v = b.build();
+//
+// Nodes go onto one contiguous tape, laid out like a FrozenDocument, and
+// all string bytes into one buffer, so building costs amortized O(1)
+// allocations however many nodes there are. to_print() serializes straight
+// from the tape in insertion order; build() materializes a Value, sizing
+// each container once. Neither recurses, so nesting depth is not limited.
+// Misuse (a value where a key is due, unbalanced end_*) throws
+// std::logic_error.
+class Builder {
 public:
-  typedef std::string::const_iterator iterator_t;
+  Builder &begin_object();
+  Builder &end_object();
+  Builder &begin_array();
+  Builder &end_array();
+  Builder &key(std::string_view name);
+  Builder &value(std::nullptr_t);
+  Builder &value(bool boolean);
+  Builder &value(std::string_view str);
+  Builder &value(const std::string &str) { return value(std::string_view(str)); }
+  Builder &value(const char *str) { return value(std::string_view(str)); }
+  Builder &value(const Value &value);
+  template <typename T, std::enable_if_t<std::is_arithmetic_v<T> &&
+                                             !std::is_same_v<T, bool>,
+                                         int> = 0>
+  Builder &value(T num) {
+    if constexpr (std::is_floating_point_v<T>)
+      return number(static_cast<double>(num));
+    else if constexpr (std::is_unsigned_v<T> && sizeof(T) >= sizeof(int64_t))
+      return num > uint64_t(INT64_MAX) ? numberText(std::to_string(num))
+                                       : number(static_cast<int64_t>(num));
+    else
+      return number(static_cast<int64_t>(num));
+  }
+
+  // A single root value has been written and every container closed.
+  bool complete() const noexcept { return !nodes_.empty() && open_.empty(); }
+  Value build() const;
+  const std::string to_print() const;
+  void to_print(std::string &out) const;
+  void clear() noexcept;
+
+private:
+  enum Repr : uint8_t { Plain, Int, Double, Text };
+  // Strings and number text: `size` bytes at `offset` in text_. Containers:
+  // `size` members or elements, `next` the index past the subtree.
+  struct Node {
+    Value::ValueType type;
+    Repr repr;
+    uint32_t size;
+    uint32_t next;
+    union {
+      uint64_t offset;
+      int64_t int_num;
+      double dbl_num;
+    };
+  };
+  Builder &number(int64_t num);
+  Builder &number(double num);
+  Builder &numberText(std::string_view text);
+  Node &push(Value::ValueType type, Repr repr);
+  Builder &beginContainer(Value::ValueType type);
+  Builder &endContainer(Value::ValueType type);
+  void appendText(Node &node, std::string_view text);
+  std::string_view text(const Node &node) const noexcept {
+    return std::string_view(text_).substr(node.offset, node.size);
+  }
+  Value buildLeaf(const Node &node) const;
+
+  std::vector<Node> nodes_;
+  std::string text_;
+  std::vector<uint32_t> open_;
+  bool expect_key_ = false;
+};
+
+namespace detail {
+// Output kernels shared by to_print, Builder and Writer.
+void appendEscaped(std::string &out, std::string_view str);
+void appendNumber(std::string &out, int64_t num);
+void appendNumber(std::string &out, double num);
+
+template <typename T> struct is_optional : std::false_type {};
+template <typename T> struct is_optional<std::optional<T>> : std::true_type {};
+
+template <typename T, typename = void> struct is_map_like : std::false_type {};
+template <typename T>
+struct is_map_like<T,
+                   std::void_t<typename T::key_type, typename T::mapped_type>>
+    : std::true_type {};
+
+template <typename T, typename = void> struct is_range : std::false_type {};
+template <typename T>
+struct is_range<T, std::void_t<decltype(std::begin(std::declval<const T &>())),
+                               decltype(std::end(std::declval<const T &>()))>>
+    : std::true_type {};
+} // namespace detail
+
+// Serializes straight into a caller-owned buffer, bypassing Value:
+//
+//   std::string buf;
+//   smalljson::Writer w(buf);
+//   w.object([&] {
+//     w.field("id", id);
+//     w.field("tags", tags);
+//   });
+//
+// Values may be null, booleans, numbers, strings, std::optional (null when
+// empty), ranges (arrays), map-like containers with string keys (objects),
+// and Value/Object/Array. Strings and numbers go through the same kernels
+// as to_print, so the output matches it byte for byte.
+class Writer {
+public:
+  explicit Writer(std::string &out) noexcept : out_(out) {}
+  template <typename Fn> Writer &object(Fn &&fn) {
+    return container('{', '}', std::forward<Fn>(fn));
+  }
+  template <typename Fn> Writer &array(Fn &&fn) {
+    return container('[', ']', std::forward<Fn>(fn));
+  }
+  Writer &key(std::string_view name) {
+    separate();
+    quote(name);
+    out_ += ':';
+    need_comma_ = false;
+    return *this;
+  }
+  template <typename T> Writer &field(std::string_view name, const T &value) {
+    return key(name).value(value);
+  }
+  template <typename T> Writer &value(const T &value);
+
+private:
+  template <typename Fn> Writer &container(char open, char close, Fn &&fn) {
+    separate();
+    out_ += open;
+    need_comma_ = false;
+    fn();
+    out_ += close;
+    need_comma_ = true;
+    return *this;
+  }
+  void separate() {
+    if (need_comma_)
+      out_ += ',';
+  }
+  void quote(std::string_view str) {
+    out_ += '"';
+    detail::appendEscaped(out_, str);
+    out_ += '"';
+  }
+
+  std::string &out_;
+  bool need_comma_ = false;
+};
+
+template <typename T> Writer &Writer::value(const T &value) {
+  if constexpr (detail::is_optional<T>::value) {
+    return value ? this->value(*value) : this->value(nullptr);
+  } else if constexpr (std::is_same_v<T, Value> || std::is_same_v<T, Object> ||
+                       std::is_same_v<T, Array>) {
+    separate();
+    value.to_print(out_);
+  } else if constexpr (std::is_same_v<T, std::nullptr_t>) {
+    separate();
+    out_ += "null";
+  } else if constexpr (std::is_same_v<T, bool>) {
+    separate();
+    out_ += value ? "true" : "false";
+  } else if constexpr (std::is_integral_v<T>) {
+    separate();
+    if constexpr (std::is_unsigned_v<T> && sizeof(T) >= sizeof(int64_t)) {
+      if (value > uint64_t(INT64_MAX)) {
+        out_ += std::to_string(value);
+        need_comma_ = true;
+        return *this;
+      }
+    }
+    detail::appendNumber(out_, static_cast<int64_t>(value));
+  } else if constexpr (std::is_floating_point_v<T>) {
+    separate();
+    detail::appendNumber(out_, static_cast<double>(value));
+  } else if constexpr (std::is_convertible_v<const T &, std::string_view>) {
+    separate();
+    quote(value);
+  } else if constexpr (std::is_same_v<T, String>) {
+    separate();
+    quote(value.view());
+  } else if constexpr (detail::is_map_like<T>::value) {
+    object([&] {
+      for (const auto &[name, item] : value) {
+        if constexpr (std::is_same_v<typename T::key_type, String>)
+          field(name.view(), item);
+        else
+          field(name, item);
+      }
+    });
+  } else if constexpr (detail::is_range<T>::value) {
+    array([&] {
+      for (const auto &item : value)
+        this->value(item);
+    });
+  } else {
+    static_assert(sizeof(T) == 0, "Writer value type error");
+  }
+  need_comma_ = true;
+  return *this;
+}
+
+// Writes records as JSON Lines (one compact document per line) to a
+// stream. Records are serialized into a reusable buffer that reaches the
+// stream in blocks of about block_size bytes. With background set, a
+// second buffer is handed to a writer thread, so encoding continues while
+// the previous block is written. write_batch() encodes a batch on several
+// threads and emits it in order. Stream failures surface as
+// std::runtime_error from the next write or flush(). The destructor
+// flushes but swallows errors; call flush() first to see them.
+class NdjsonWriter {
+public:
+  explicit NdjsonWriter(std::ostream &out, size_t block_size = 1 << 20,
+                        bool background = false);
+  NdjsonWriter(const NdjsonWriter &) = delete;
+  NdjsonWriter &operator=(const NdjsonWriter &) = delete;
+  ~NdjsonWriter();
+
+  void write(const Value &record);
+  // Writes one record through a Writer: write([&](Writer &w) { ... }).
+  template <typename Fn,
+            std::enable_if_t<std::is_invocable_v<Fn, Writer &>, int> = 0>
+  void write(Fn &&fn) {
+    Writer writer(buffer_);
+    fn(writer);
+    endRecord();
+  }
+  // threads == 0 uses std::thread::hardware_concurrency().
+  void write_batch(const std::vector<Value> &records, unsigned threads = 0);
+  void flush();
+
+private:
+  void endRecord() {
+    buffer_ += '\n';
+    if (buffer_.size() >= block_size_)
+      flushBlock();
+  }
+  void flushBlock();
+  void writerLoop();
+  void checkError();
+
+  std::ostream &out_;
+  size_t block_size_;
+  std::string buffer_;
+  bool background_;
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::string pending_;
+  bool busy_ = false;
+  bool stop_ = false;
+  bool failed_ = false;
+};
+
+// RFC 6901 JSON Pointer, e.g. "/servers/0/name" (with "~1" for '/' and
+// "~0" for '~' inside a token). The empty pointer is the whole document.
+// A malformed pointer throws std::invalid_argument.
+class JsonPointer {
+public:
+  explicit JsonPointer(std::string_view text);
+  const std::vector<std::string> &tokens() const noexcept { return tokens_; }
+  const Value *find(const Value &root) const noexcept;
+
+private:
+  std::vector<std::string> tokens_;
+};
+
+// Filter and aggregate over JSON Lines without building Values:
+//
+//   smalljson::Query query;
+//   query.where("/level", smalljson::Query::Op::Eq, "error")
+//       .group_by("/service")
+//       .metric("/latency_ms");
+//   for (auto &[service, group] : query.run(text))
+//     ... group.count, group.metrics[0].sum / .min / .max ...
+//
+// Each record is walked once, only as far as the referenced fields,
+// skipping everything else in place. The input is split at line
+// boundaries across threads whose partial aggregates are merged at the
+// end. where() clauses are ANDed; a missing field fails every comparison
+// except Ne. Group keys are the field's compact JSON text (strings keep
+// their quotes), "null" when missing, and "" without group_by(). Metrics
+// count, sum, min and max the numeric values of a field. A malformed
+// record throws Exception with offset() at the start of that record.
+class Query {
+public:
+  enum class Op { Exists, Eq, Ne, Lt, Le, Gt, Ge };
+  struct Stats {
+    uint64_t count = 0;
+    double sum = 0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+  };
+  struct Group {
+    uint64_t count = 0;
+    std::vector<Stats> metrics;
+  };
+  typedef std::map<std::string, Group, std::less<>> result_t;
+
+  Query &where(std::string_view pointer, Op op, const Value &operand = Value());
+  Query &group_by(std::string_view pointer);
+  Query &metric(std::string_view pointer);
+  // threads == 0 uses std::thread::hardware_concurrency().
+  result_t run(std::string_view ndjson, unsigned threads = 0) const;
+
+private:
+  struct Predicate {
+    JsonPointer pointer;
+    Op op;
+    Value::ValueType type;
+    std::string text;
+    double number;
+  };
+  void runChunk(std::string_view chunk, size_t base, result_t &groups) const;
+  // tokens: the record's predicate fields, then group_by's, then metrics'.
+  void aggregate(const std::optional<std::string_view> *tokens,
+                 result_t &groups, std::string &scratch,
+                 std::string &key_scratch) const;
+  bool test(const Predicate &pred, const std::optional<std::string_view> &token,
+            std::string &scratch) const;
+
+  std::vector<Predicate> predicates_;
+  std::optional<JsonPointer> group_by_;
+  std::vector<JsonPointer> metrics_;
+};
+
+// Compile-time parser configuration. Derive from ParseOptions and
+// override the members that differ; every configuration gets its own
+// instantiation of BasicParser, so disabled features cost nothing in the
+// hot loops.
+//
+//   struct Options : smalljson::ParseOptions {
+//     static constexpr bool comments = true;
+//   };
+//   smalljson::Value value = smalljson::Parser::parse<Options>(text);
+struct ParseOptions {
+  // "// line" and "/* block */" comments wherever whitespace is allowed.
+  static constexpr bool comments = false;
+  // A ',' before the closing '}' or ']'.
+  static constexpr bool trailing_commas = false;
+  // NaN, Infinity and -Infinity as number values.
+  static constexpr bool nan_infinity = false;
+  // Reject strings that are not well-formed UTF-8 (BAD_UTF8).
+  static constexpr bool validate_utf8 = false;
+  // Keep numbers as Number spans into the input; see Document.
+  static constexpr bool zero_copy = false;
+  // Nesting limit for objects and arrays (TOO_DEEP), 0 for none.
+  static constexpr unsigned max_depth = 1024;
+  static constexpr DuplicateKeys duplicate_keys = DuplicateKeys::LastWins;
+  static constexpr NumberMode number_mode = NumberMode::Binary;
+  static constexpr HashIndex hash_index = HashIndex::Auto;
+};
+
+// The extensions commonly found in configuration files.
+struct RelaxedParseOptions : ParseOptions {
+  static constexpr bool comments = true;
+  static constexpr bool trailing_commas = true;
+  static constexpr bool nan_infinity = true;
+};
+
+namespace detail {
+std::string unescapeJson(std::string_view str);
+// Past the value starting at cur, without building it. Strings and bracket
+// nesting are tracked, containers 64 bytes at a time; nothing else is
+// validated. Throws Exception if the value is cut short.
+const char *skipValue(const char *cur, const char *end);
+// Runs work(0) .. work(parts - 1), all but the first on threads of their
+// own (or inline when no thread can be started), and returns once every
+// part is done, rethrowing the exception of the lowest part that threw.
+void runParts(unsigned parts, const std::function<void(unsigned)> &work);
+} // namespace detail
+
+template <typename Options = ParseOptions> class BasicParser {
+public:
+  // Parsing runs over any contiguous range of bytes.
+  typedef const char *iterator_t;
   static Value parse(const std::string &json_data) {
-    return Parser(json_data).parseStart();
+    static_assert(!Options::zero_copy,
+                  "zero-copy parsing needs a Document to own the input");
+    return BasicParser(json_data.data(), json_data.data() + json_data.size())
+        .parseStart();
+  }
+  // Builds only the listed members of the root object and skips the rest.
+  static Value parse_keys(const std::string &json_data,
+                          const std::vector<std::string_view> &keys) {
+    static_assert(!Options::zero_copy,
+                  "zero-copy parsing needs a Document to own the input");
+    BasicParser parser(json_data.data(),
+                       json_data.data() + json_data.size());
+    parser.keys_ = &keys;
+    return parser.parseStart();
   }
+  static void parse_many(const std::vector<std::string_view> &inputs,
+                         std::vector<Value> &out, unsigned threads = 0);
 
 private:
-  Parser(const std::string &json_data)
-      : cur_(json_data.begin()), end_(json_data.end()) {}
+  friend class Parser;
+  friend class Cursor;
+  friend class JsonReader;
+  friend class JsonStream;
+  friend class FrozenValue;
+  friend class Document;
+  BasicParser(iterator_t cur, iterator_t end) : cur_(cur), end_(end) {}
   Value parseStart();
+  Value parseRoot();
+  // The object or array at cur_, leaving cur_ just past it.
+  Value parseContainer();
   Value parseObject();
   Value parseArray();
   Value parseValue();
   Value parseString();
   Value parseBoolean();
   Value parseNumber();
+  Value parseNonFinite();
   Value parseNull();
-  std::string parseRawString();
+  String parseJsonString();
+  std::string_view parseRawString(bool &escaped);
   void skipWhiteSpace();
+  void skipComment();
   void skipDigit();
+  void skipValue();
+  bool selected(std::string_view key) const;
+  void enter();
+  // The current byte, or '\0' at the end: reads never go past end_, so
+  // the input needs no terminator.
+  char peek() const noexcept { return cur_ != end_ ? *cur_ : '\0'; }
+  static bool isDigit(char ch) noexcept { return ch >= '0' && ch <= '9'; }
 
 private:
   iterator_t cur_, end_;
+  unsigned depth_ = 0;
+  // Members of the root object to build, or null for all of them.
+  const std::vector<std::string_view> *keys_ = nullptr;
+  // Elements of the arrays being parsed, innermost last. Each array is
+  // moved out into storage of its exact size once it closes, so the only
+  // buffer that grows is this one, and parse_many keeps it from input to
+  // input.
+  std::vector<Value> stack_;
+};
+
+extern template class BasicParser<ParseOptions>;
+extern template class BasicParser<RelaxedParseOptions>;
+
+class Parser {
+public:
+  typedef BasicParser<>::iterator_t iterator_t;
+  // Runtime choice among the prebuilt configurations.
+  static Value parse(const std::string &json_data,
+                     NumberMode mode = NumberMode::Binary,
+                     DuplicateKeys keys = DuplicateKeys::LastWins);
+  static Value parse(const std::string &json_data, DuplicateKeys keys) {
+    return parse(json_data, NumberMode::Binary, keys);
+  }
+  template <typename Options> static Value parse(const std::string &json_data) {
+    return BasicParser<Options>::parse(json_data);
+  }
+  // Only the listed top-level members are built; every other value is
+  // skipped in place. A root array is parsed in full.
+  static Value parse_keys(const std::string &json_data,
+                          const std::vector<std::string_view> &keys) {
+    return BasicParser<>::parse_keys(json_data, keys);
+  }
+  template <typename Options>
+  static Value parse_keys(const std::string &json_data,
+                          const std::vector<std::string_view> &keys) {
+    return BasicParser<Options>::parse_keys(json_data, keys);
+  }
+  // Parses inputs[i] into out[i] (out is resized to match) with one parser
+  // per thread, reading each input in place and reusing the parser's
+  // buffers from input to input. threads == 0 uses
+  // std::thread::hardware_concurrency(); each thread takes a contiguous
+  // slice of at least 256 inputs. Every input is attempted: one that fails
+  // is left Null in out (a parsed root is always an Object or Array), and
+  // the failure of the lowest-index input is rethrown once the batch is
+  // done.
+  static void parse_many(const std::vector<std::string_view> &inputs,
+                         std::vector<Value> &out, unsigned threads = 0) {
+    BasicParser<>::parse_many(inputs, out, threads);
+  }
+  template <typename Options>
+  static void parse_many(const std::vector<std::string_view> &inputs,
+                         std::vector<Value> &out, unsigned threads = 0) {
+    BasicParser<Options>::parse_many(inputs, out, threads);
+  }
+};
+
+// A parsed tree together with the input it was parsed from. Numbers are
+// kept as Number spans into that input and only decoded when read, and
+// to_print() echoes them unchanged. Values reached through a Document must
+// not outlive it; copying a Value out detaches it.
+//
+// Given Arena::Options, the tree is allocated from an Arena the Document
+// owns, which is released in one go with it.
+class Document {
+public:
+  Document() : input_(std::make_unique<std::string>()) {}
+  Document(Document &&rhs) noexcept = default;
+  Document &operator=(Document &&rhs) noexcept {
+    // The old tree goes first, while its arena is still there.
+    root_ = std::move(rhs.root_);
+    input_ = std::move(rhs.input_);
+    arena_ = std::move(rhs.arena_);
+    return *this;
+  }
+  static Document parse(std::string json_data,
+                        DuplicateKeys keys = DuplicateKeys::LastWins);
+  static Document parse(std::string json_data, const Arena::Options &arena,
+                        DuplicateKeys keys = DuplicateKeys::LastWins);
+  template <typename Options> static Document parse(std::string json_data);
+  template <typename Options>
+  static Document parse(std::string json_data, const Arena::Options &arena);
+  Value &root() noexcept { return root_; }
+  const Value &root() const noexcept { return root_; }
+  const std::string &input() const noexcept { return *input_; }
+  // The arena holding the tree, or null when it lives on the heap.
+  const Arena *arena() const noexcept { return arena_.get(); }
+
+private:
+  std::unique_ptr<std::string> input_;
+  // Declared before root_, so the tree is destroyed first.
+  std::unique_ptr<Arena> arena_;
+  Value root_;
 };
 
 class Exception : public std::exception {
@@ -271,13 +1355,1242 @@ public:
     BAD_BOOLEAN,
     BAD_NULL,
     BAD_NUMBER,
-    BAD_TYPE
+    BAD_TYPE,
+    DUPLICATE_KEY,
+    BAD_COMMENT,
+    BAD_UTF8,
+    TOO_DEEP
+  };
+  static constexpr size_t npos = static_cast<size_t>(-1);
+
+  // Where an error sits in the input, worked out by locate().
+  struct Location {
+    size_t line;   // 1-based
+    size_t column; // 1-based, in bytes
+    std::string snippet;
+    size_t caret; // index of the offending byte in snippet
   };
+
   explicit Exception(ParseError err) : err_(err) {}
   const char *what() const noexcept { return errorToStr(); }
+  ParseError error() const noexcept { return err_; }
+  // Byte offset into the input at which parsing stopped, or npos.
+  size_t offset() const noexcept { return offset_; }
+  // Line, column and the surrounding text of offset(). `input` must be the
+  // text that was parsed; nothing is computed until this is called. An
+  // npos offset is placed at the end of `input`.
+  Location locate(std::string_view input, size_t context = 32) const;
 
 private:
+  template <typename Options> friend class BasicParser;
+  friend class JsonReader;
+  friend class JsonStream;
+  friend class Query;
   const char *errorToStr() const;
   ParseError err_;
+  size_t offset_ = npos;
+};
+
+template <typename Options> Value BasicParser<Options>::parseStart() {
+  iterator_t begin = cur_;
+  try {
+    return parseRoot();
+  } catch (Exception &err) {
+    err.offset_ = cur_ - begin;
+    throw;
+  }
+}
+
+template <typename Options>
+void BasicParser<Options>::parse_many(
+    const std::vector<std::string_view> &inputs, std::vector<Value> &out,
+    unsigned threads) {
+  static_assert(!Options::zero_copy,
+                "zero-copy parsing needs a Document to own the input");
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  unsigned parts = static_cast<unsigned>(std::max<size_t>(
+      1, std::min<size_t>(threads, inputs.size() / 256)));
+  out.resize(inputs.size());
+  std::vector<std::exception_ptr> errors(parts);
+  detail::runParts(parts, [&](unsigned part) {
+    size_t first = inputs.size() * part / parts;
+    size_t last = inputs.size() * (part + 1) / parts;
+    BasicParser parser(nullptr, nullptr);
+    for (size_t idx = first; idx < last; idx++) {
+      parser.cur_ = inputs[idx].data();
+      parser.end_ = inputs[idx].data() + inputs[idx].size();
+      parser.depth_ = 0;
+      try {
+        out[idx] = parser.parseStart();
+      } catch (...) {
+        out[idx] = Value();
+        parser.stack_.clear();
+        if (!errors[part])
+          errors[part] = std::current_exception();
+      }
+    }
+  });
+  for (auto &error : errors) {
+    if (error)
+      std::rethrow_exception(error);
+  }
+}
+
+template <typename Options> Value BasicParser<Options>::parseRoot() {
+  skipWhiteSpace();
+  Value ret = parseContainer();
+  skipWhiteSpace();
+  if (cur_ != end_)
+    throw Exception(Exception::ParseError::ROOT_NOT_ONE);
+  return ret;
+}
+
+template <typename Options> Value BasicParser<Options>::parseContainer() {
+  switch (peek()) {
+  case '{':
+    return parseObject();
+  case '[':
+    keys_ = nullptr;
+    return parseArray();
+  default:
+    throw Exception(Exception::ParseError::NOT_JSON);
+  }
+}
+
+template <typename Options> void BasicParser<Options>::skipWhiteSpace() {
+  while (true) {
+    while (cur_ != end_ &&
+           (*cur_ == ' ' || *cur_ == '\n' || *cur_ == '\r' || *cur_ == '\t'))
+      cur_++;
+    if constexpr (!Options::comments) {
+      return;
+    } else {
+      if (cur_ == end_ || *cur_ != '/')
+        return;
+      skipComment();
+    }
+  }
+}
+
+template <typename Options> void BasicParser<Options>::skipComment() {
+  assert(*cur_ == '/');
+  cur_++;
+  if (cur_ != end_ && *cur_ == '/') {
+    while (cur_ != end_ && *cur_ != '\n')
+      cur_++;
+    return;
+  }
+  if (cur_ == end_ || *cur_ != '*')
+    throw Exception(Exception::ParseError::BAD_COMMENT);
+  for (cur_++; cur_ != end_; cur_++) {
+    if (*cur_ == '*' && cur_ + 1 != end_ && *(cur_ + 1) == '/') {
+      cur_ += 2;
+      return;
+    }
+  }
+  throw Exception(Exception::ParseError::BAD_COMMENT);
+}
+
+template <typename Options> void BasicParser<Options>::skipDigit() {
+  while (cur_ != end_ && isDigit(*cur_))
+    cur_++;
+}
+
+template <typename Options> void BasicParser<Options>::skipValue() {
+  if constexpr (Options::comments) {
+    // A comment can hide brackets from the raw scan.
+    parseValue();
+  } else {
+    if (cur_ == end_)
+      throw Exception(Exception::ParseError::MISS_VALUE);
+    const char *first = &*cur_;
+    cur_ += detail::skipValue(first, first + (end_ - cur_)) - first;
+  }
+}
+
+template <typename Options>
+bool BasicParser<Options>::selected(std::string_view key) const {
+  for (std::string_view wanted : *keys_) {
+    if (wanted == key)
+      return true;
+  }
+  return false;
+}
+
+template <typename Options> void BasicParser<Options>::enter() {
+  if constexpr (Options::max_depth != 0) {
+    if (++depth_ > Options::max_depth)
+      throw Exception(Exception::ParseError::TOO_DEEP);
+  }
+}
+
+template <typename Options> Value BasicParser<Options>::parseObject() {
+  assert(*cur_ == '{');
+  enter();
+  cur_++;
+  skipWhiteSpace();
+  // Only the root object is filtered.
+  bool filtered = keys_ != nullptr;
+  Object::object_t object_data;
+  while (peek() != '}') {
+    skipWhiteSpace();
+    iterator_t key_at = cur_;
+    String key = parseJsonString();
+    skipWhiteSpace();
+    if (peek() != ':')
+      throw Exception(Exception::ParseError::MISS_COLON);
+    cur_++;
+    skipWhiteSpace();
+    if (filtered && !selected(key)) {
+      skipValue();
+      skipWhiteSpace();
+    } else {
+      const auto *keys = keys_;
+      keys_ = nullptr;
+      Value value = parseValue();
+      keys_ = keys;
+      skipWhiteSpace();
+      // try_emplace leaves key and value untouched when the key exists, so
+      // detecting a duplicate costs the lookup the insert does anyway.
+      if constexpr (Options::duplicate_keys == DuplicateKeys::LastWins) {
+        object_data.insert_or_assign(std::move(key), std::move(value));
+      } else if (!object_data.try_emplace(std::move(key), std::move(value))
+                      .second &&
+                 Options::duplicate_keys == DuplicateKeys::Reject) {
+        // Reported at the repeated key, not past its value.
+        cur_ = key_at;
+        throw Exception(Exception::ParseError::DUPLICATE_KEY);
+      }
+    }
+    if (peek() == ',') {
+      cur_++;
+      if constexpr (Options::trailing_commas)
+        skipWhiteSpace();
+      else if (peek() == '}')
+        throw Exception(Exception::ParseError::BAD_KEY);
+    } else if (peek() != '}') {
+      throw Exception(Exception::ParseError::LACK_COMMA_OR_BRACE);
+    }
+  }
+  cur_++;
+  depth_--;
+  return Object(std::move(object_data), Options::hash_index);
+}
+
+template <typename Options> Value BasicParser<Options>::parseArray() {
+  assert(*cur_ == '[');
+  enter();
+  cur_++;
+  skipWhiteSpace();
+  size_t base = stack_.size();
+  while (peek() != ']') {
+    skipWhiteSpace();
+    Value value = parseValue();
+    skipWhiteSpace();
+    stack_.emplace_back(std::move(value));
+    if (peek() == ',') {
+      cur_++;
+      if constexpr (Options::trailing_commas)
+        skipWhiteSpace();
+      else if (peek() == ']')
+        throw Exception(Exception::ParseError::BAD_VALUE);
+    } else if (peek() != ']') {
+      throw Exception(Exception::ParseError::LACK_COMMA_OR_BRACKET);
+    }
+  }
+  cur_++;
+  depth_--;
+  Array::array_t array_data(std::make_move_iterator(stack_.begin() + base),
+                            std::make_move_iterator(stack_.end()));
+  stack_.resize(base);
+  return Array(std::move(array_data));
+}
+
+template <typename Options> Value BasicParser<Options>::parseValue() {
+  char ch = peek();
+  switch (ch) {
+  case 't':
+  case 'f':
+    return parseBoolean();
+  case 'n':
+    return parseNull();
+  case '"':
+    return parseString();
+  case '[':
+    return parseArray();
+  case '{':
+    return parseObject();
+  default:
+    break;
+  }
+  if constexpr (Options::nan_infinity) {
+    if (ch == 'N' || ch == 'I' ||
+        (ch == '-' && cur_ + 1 != end_ && *(cur_ + 1) == 'I'))
+      return parseNonFinite();
+  }
+  if (ch == '-' || isDigit(ch)) {
+    return parseNumber();
+  }
+  throw Exception(Exception::ParseError::BAD_VALUE);
+  return nullptr;
+}
+
+template <typename Options>
+std::string_view BasicParser<Options>::parseRawString(bool &escaped) {
+  if (peek() != '"') {
+    throw Exception(Exception::ParseError::BAD_KEY);
+  }
+  cur_++;
+  iterator_t old_cur = cur_;
+  bool closed = false;
+  while (!closed && cur_ != end_) {
+    if (*cur_ == '\\') {
+      escaped = true;
+      cur_++;
+      if (cur_ == end_)
+        throw Exception(Exception::ParseError::BAD_ESCAPE);
+      switch (*cur_) {
+      case '"':
+      case '\\':
+      case '/':
+      case 't':
+      case 'r':
+      case 'n':
+      case 'b':
+      case 'f':
+        cur_++;
+        break;
+      case 'u':
+        cur_++;
+        for (int idx = 0; idx < 4; idx++, cur_++) {
+          if (cur_ == end_ || !std::isxdigit(static_cast<unsigned char>(*cur_)))
+            throw Exception(Exception::ParseError::BAD_ESCAPE);
+        }
+        break;
+      default:
+        throw Exception(Exception::ParseError::BAD_ESCAPE);
+        break;
+      }
+    } else {
+      closed = *cur_ == '"';
+      cur_++;
+    }
+  }
+  if (!closed) {
+    throw Exception(Exception::ParseError::JSON_LENGTH);
+  }
+  return std::string_view(&*old_cur, cur_ - 1 - old_cur);
+}
+
+template <typename Options> String BasicParser<Options>::parseJsonString() {
+  bool escaped = false;
+  std::string_view raw = parseRawString(escaped);
+  String str = escaped ? String(detail::unescapeJson(raw)) : String(raw);
+  if constexpr (Options::validate_utf8) {
+    if (!str.valid_utf8())
+      throw Exception(Exception::ParseError::BAD_UTF8);
+  }
+  return str;
+}
+
+template <typename Options> Value BasicParser<Options>::parseString() {
+  return Value(Value::ValueType::String, parseJsonString());
+}
+
+template <typename Options> Value BasicParser<Options>::parseBoolean() {
+  assert(peek() == 't' || peek() == 'f');
+  std::string_view rest(&*cur_, end_ - cur_);
+  switch (*cur_) {
+  case 't':
+    if (rest.substr(0, 4) == "true") {
+      cur_ += 4;
+      return Value(Value::ValueType::Boolean, String("true", 4));
+    }
+    break;
+  case 'f':
+    if (rest.substr(0, 5) == "false") {
+      cur_ += 5;
+      return Value(Value::ValueType::Boolean, String("false", 5));
+    }
+    break;
+  default:
+    break;
+  }
+  throw Exception(Exception::ParseError::BAD_BOOLEAN);
+  return nullptr;
+}
+
+template <typename Options> Value BasicParser<Options>::parseNull() {
+  assert(peek() == 'n');
+  if (std::string_view(&*cur_, end_ - cur_).substr(0, 4) == "null") {
+    cur_ += 4;
+    return Value();
+  }
+  throw Exception(Exception::ParseError::BAD_NULL);
+  return nullptr;
+}
+
+template <typename Options> Value BasicParser<Options>::parseNonFinite() {
+  std::string_view rest(&*cur_, end_ - cur_);
+  for (std::string_view word : {"NaN", "Infinity", "-Infinity"}) {
+    if (rest.substr(0, word.size()) == word) {
+      cur_ += word.size();
+      double num = word[0] == 'N'   ? std::numeric_limits<double>::quiet_NaN()
+                   : word[0] == '-' ? -std::numeric_limits<double>::infinity()
+                                    : std::numeric_limits<double>::infinity();
+      return Value(Value::ValueType::Number, num);
+    }
+  }
+  throw Exception(Exception::ParseError::BAD_NUMBER);
+}
+
+template <typename Options> Value BasicParser<Options>::parseNumber() {
+  iterator_t old_cur = cur_;
+  if (peek() == '-') {
+    cur_++;
+  }
+  if (!isDigit(peek())) {
+    throw Exception(Exception::ParseError::BAD_NUMBER);
+  }
+  if (*cur_ == '0' && cur_ + 1 != end_ && isDigit(*(cur_ + 1))) {
+    throw Exception(Exception::ParseError::BAD_NUMBER);
+  }
+  iterator_t int_begin = cur_;
+  skipDigit();
+  size_t int_digits = cur_ - int_begin;
+  size_t significant = *int_begin == '0' ? 0 : int_digits;
+  bool integral = true;
+  if (cur_ != end_ && *cur_ == '.') {
+    integral = false;
+    cur_++;
+    iterator_t frac_begin = cur_;
+    skipDigit();
+    if (cur_ == frac_begin) {
+      throw Exception(Exception::ParseError::BAD_NUMBER);
+    }
+    iterator_t first_digit = frac_begin;
+    while (significant == 0 && first_digit != cur_ && *first_digit == '0')
+      first_digit++;
+    significant += cur_ - first_digit;
+  }
+  int exponent = 0;
+  bool scientific = false;
+  if (cur_ != end_ && (*cur_ == 'e' || *cur_ == 'E')) {
+    integral = false;
+    scientific = true;
+    cur_++;
+    bool negative = cur_ != end_ && *cur_ == '-';
+    if (cur_ != end_ && (*cur_ == '+' || *cur_ == '-')) {
+      cur_++;
+    }
+    if (!isDigit(peek())) {
+      throw Exception(Exception::ParseError::BAD_NUMBER);
+    }
+    for (; cur_ != end_ && isDigit(*cur_); cur_++) {
+      if (exponent < 100000)
+        exponent = exponent * 10 + (*cur_ - '0');
+    }
+    exponent = negative ? -exponent : exponent;
+  }
+  const char *first = &*old_cur;
+  const char *last = first + (cur_ - old_cur);
+  int magnitude = exponent + static_cast<int>(int_digits);
+  bool exact = !integral && significant <= 15 && magnitude > -290 &&
+               magnitude < 290;
+  if constexpr (Options::zero_copy) {
+    uint8_t hint = integral     ? Number::Integer
+                   : scientific ? Number::Exponent
+                                : Number::Fraction;
+    int64_t num = 0;
+    if (integral ? int_digits < 19 ||
+                       (int_digits == 19 &&
+                        std::from_chars(first, last, num).ec == std::errc())
+                 : exact)
+      hint |= Number::Exact;
+    return Value(Value::ValueType::Number,
+                 Number(first, static_cast<uint32_t>(last - first), hint));
+  }
+  if (integral && int_digits <= 19) {
+    int64_t num = 0;
+    if (std::from_chars(first, last, num).ec == std::errc())
+      return Value(Value::ValueType::Number, num);
+  }
+  if (exact || Options::number_mode == NumberMode::Binary)
+    return Value(Value::ValueType::Number, detail::decodeDouble(first, last));
+  return Value(Value::ValueType::Number,
+               String(first, static_cast<size_t>(last - first)));
+}
+
+template <typename Options>
+Document Document::parse(std::string json_data) {
+  Document doc;
+  *doc.input_ = std::move(json_data);
+  doc.root_ = BasicParser<Options>(doc.input_->data(),
+                                   doc.input_->data() + doc.input_->size())
+                  .parseStart();
+  return doc;
+}
+
+template <typename Options>
+Document Document::parse(std::string json_data, const Arena::Options &arena) {
+  Document doc;
+  *doc.input_ = std::move(json_data);
+  doc.arena_ = std::make_unique<Arena>(arena);
+  ArenaScope scope(*doc.arena_);
+  doc.root_ = BasicParser<Options>(doc.input_->data(),
+                                   doc.input_->data() + doc.input_->size())
+                  .parseStart();
+  return doc;
+}
+
+// Conversion between C++ types and Value. Built in: Value/Object/Array,
+// strings, bool and arithmetic types, std::optional, std::pair/std::tuple
+// (fixed-size arrays), sequence containers and std::array (arrays) and
+// map-like containers with string keys (objects), nested freely. Other types
+// opt in by specializing JsonTraits:
+//
+//   template <> struct smalljson::JsonTraits<Point> {
+//     static Value to_json(const Point &p) { return Array{p.x, p.y}; }
+//     static Point from_json(const Value &value);
+//   };
+//
+// Containers are converted with exact reservations, and passing one as an
+// rvalue moves its elements. from_json throws Exception BAD_TYPE when the
+// Value does not have the expected shape or a number does not fit.
+template <typename T, typename = void> struct JsonTraits {
+  static_assert(sizeof(T) == 0, "no JsonTraits for this type");
+};
+
+template <typename T> Value to_json(T &&value) {
+  return JsonTraits<std::decay_t<T>>::to_json(std::forward<T>(value));
+}
+
+template <typename T> T from_json(const Value &value) {
+  return JsonTraits<T>::from_json(value);
+}
+
+namespace detail {
+template <typename T> struct is_std_array : std::false_type {};
+template <typename T, size_t N>
+struct is_std_array<std::array<T, N>> : std::true_type {};
+
+template <typename T, typename = void> struct has_reserve : std::false_type {};
+template <typename T>
+struct has_reserve<T, std::void_t<decltype(std::declval<T &>().reserve(0))>>
+    : std::true_type {};
+
+template <typename T>
+constexpr bool is_json_type_v =
+    std::is_same_v<T, Value> || std::is_same_v<T, Object> ||
+    std::is_same_v<T, Array> || std::is_same_v<T, String>;
+
+template <typename T, typename = void>
+struct has_string_key : std::false_type {};
+template <typename T>
+struct has_string_key<
+    T, std::void_t<typename T::key_type, typename T::mapped_type>>
+    : std::is_constructible<typename T::key_type, std::string> {};
+
+template <typename T>
+constexpr bool is_json_object_v = !is_json_type_v<T> && has_string_key<T>::value;
+
+template <typename T>
+constexpr bool is_json_array_v =
+    !is_json_type_v<T> && !is_map_like<T>::value && is_range<T>::value &&
+    !std::is_convertible_v<const T &, std::string_view>;
+
+[[noreturn]] inline void badType() {
+  throw Exception(Exception::ParseError::BAD_TYPE);
+}
+} // namespace detail
+
+template <> struct JsonTraits<Value> {
+  static Value to_json(const Value &value) { return value; }
+  static Value to_json(Value &&value) { return std::move(value); }
+  static Value from_json(const Value &value) { return value; }
+};
+
+template <typename T>
+struct JsonTraits<T, std::enable_if_t<std::is_same_v<T, Object> ||
+                                      std::is_same_v<T, Array>>> {
+  static Value to_json(const T &value) { return Value(value); }
+  static Value to_json(T &&value) { return Value(std::move(value)); }
+  static T from_json(const Value &value) {
+    if (auto pval = value.get_if<T>())
+      return *pval;
+    detail::badType();
+  }
+};
+
+template <typename T>
+struct JsonTraits<T, std::enable_if_t<std::is_same_v<T, std::string> ||
+                                      std::is_same_v<T, String>>> {
+  static Value to_json(const T &value) { return Value(value); }
+  static T from_json(const Value &value) {
+    if (auto str = value.get<std::string_view>())
+      return T(*str);
+    detail::badType();
+  }
+};
+
+template <> struct JsonTraits<std::string_view> {
+  static Value to_json(std::string_view value) { return Value(value); }
+};
+
+template <> struct JsonTraits<const char *> {
+  static Value to_json(const char *value) { return Value(value); }
+};
+
+template <> struct JsonTraits<std::nullptr_t> {
+  static Value to_json(std::nullptr_t) { return Value(); }
+};
+
+template <typename T>
+struct JsonTraits<T, std::enable_if_t<std::is_arithmetic_v<T>>> {
+  static Value to_json(T value) { return Value(value); }
+  static T from_json(const Value &value) {
+    if (auto num = value.get<T>())
+      return *num;
+    detail::badType();
+  }
+};
+
+template <typename T> struct JsonTraits<std::optional<T>> {
+  template <typename U> static Value to_json(U &&value) {
+    return value ? smalljson::to_json(*std::forward<U>(value)) : Value();
+  }
+  static std::optional<T> from_json(const Value &value) {
+    if (value.isNull())
+      return std::nullopt;
+    return JsonTraits<T>::from_json(value);
+  }
+};
+
+template <typename... Ts> struct JsonTraits<std::tuple<Ts...>> {
+  template <typename U> static Value to_json(U &&value) {
+    return std::apply(
+        [](auto &&...items) {
+          Array::array_t array_data;
+          array_data.reserve(sizeof...(Ts));
+          (array_data.emplace_back(
+               smalljson::to_json(std::forward<decltype(items)>(items))),
+           ...);
+          return Value(Array(std::move(array_data)));
+        },
+        std::forward<U>(value));
+  }
+  static std::tuple<Ts...> from_json(const Value &value) {
+    auto arr = value.get_if<Array>();
+    if (!arr || arr->size() != sizeof...(Ts))
+      detail::badType();
+    return fromArray(*arr, std::index_sequence_for<Ts...>());
+  }
+
+private:
+  template <size_t... Is>
+  static std::tuple<Ts...> fromArray(const Array &arr,
+                                     std::index_sequence<Is...>) {
+    return std::tuple<Ts...>(JsonTraits<Ts>::from_json(arr.at(Is))...);
+  }
+};
+
+template <typename A, typename B> struct JsonTraits<std::pair<A, B>> {
+  template <typename U> static Value to_json(U &&value) {
+    return JsonTraits<std::tuple<A, B>>::to_json(
+        std::tuple<A, B>(std::forward<U>(value)));
+  }
+  static std::pair<A, B> from_json(const Value &value) {
+    auto [first, second] = JsonTraits<std::tuple<A, B>>::from_json(value);
+    return std::pair<A, B>(std::move(first), std::move(second));
+  }
+};
+
+template <typename T>
+struct JsonTraits<T, std::enable_if_t<detail::is_json_array_v<T>>> {
+  typedef typename T::value_type item_t;
+
+  template <typename U> static Value to_json(U &&value) {
+    Array::array_t array_data;
+    array_data.reserve(std::distance(std::begin(value), std::end(value)));
+    for (auto &&item : value) {
+      if constexpr (std::is_rvalue_reference_v<U &&> &&
+                    !std::is_same_v<item_t, bool>)
+        array_data.emplace_back(JsonTraits<item_t>::to_json(std::move(item)));
+      else
+        array_data.emplace_back(
+            JsonTraits<item_t>::to_json(static_cast<const item_t &>(item)));
+    }
+    return Array(std::move(array_data));
+  }
+  static T from_json(const Value &value) {
+    auto arr = value.get_if<Array>();
+    if (!arr)
+      detail::badType();
+    T result{};
+    if constexpr (detail::is_std_array<T>::value) {
+      if (arr->size() != result.size())
+        detail::badType();
+      for (size_t idx = 0; idx < result.size(); idx++)
+        result[idx] = JsonTraits<item_t>::from_json(arr->at(idx));
+    } else {
+      if constexpr (detail::has_reserve<T>::value)
+        result.reserve(arr->size());
+      for (auto &item : *arr)
+        result.insert(result.end(), JsonTraits<item_t>::from_json(item));
+    }
+    return result;
+  }
+};
+
+template <typename T>
+struct JsonTraits<T, std::enable_if_t<detail::is_json_object_v<T>>> {
+  typedef typename T::mapped_type item_t;
+
+  template <typename U> static Value to_json(U &&value) {
+    Object::object_t object_data;
+    for (auto &&[name, item] : value) {
+      // Sorted sources append at the end in O(1).
+      if constexpr (std::is_rvalue_reference_v<U &&>)
+        object_data.emplace_hint(object_data.end(), String(name),
+                                 JsonTraits<item_t>::to_json(std::move(item)));
+      else
+        object_data.emplace_hint(object_data.end(), String(name),
+                                 JsonTraits<item_t>::to_json(item));
+    }
+    return Object(std::move(object_data));
+  }
+  static T from_json(const Value &value) {
+    auto obj = value.get_if<Object>();
+    if (!obj)
+      detail::badType();
+    T result;
+    if constexpr (detail::has_reserve<T>::value)
+      result.reserve(obj->size());
+    for (auto &[name, item] : *obj)
+      result.emplace(name.str(), JsonTraits<item_t>::from_json(item));
+    return result;
+  }
+};
+
+// Low-level scanner over raw JSON text, used by the parsers that
+// smalljson_codegen emits. Keys are returned raw (still escaped); values of
+// unknown fields fall back to the generic Parser via read_value().
+class Cursor {
+public:
+  typedef Parser::iterator_t iterator_t;
+
+  explicit Cursor(const std::string &json_data)
+      : begin_(json_data.data()), cur_(json_data.data()),
+        end_(json_data.data() + json_data.size()) {}
+  // The Cursor keeps iterators into the string, so it must outlive it.
+  explicit Cursor(std::string &&) = delete;
+  size_t offset() const noexcept { return cur_ - begin_; }
+  void skip_whitespace();
+  bool consume(char ch);
+  void expect(char ch, Exception::ParseError err);
+  bool consume_null();
+  void finish();
+  std::string_view read_key();
+  int64_t read_int64();
+  double read_double();
+  bool read_boolean();
+  std::string read_string();
+  Value read_value();
+  // Steps over the next value without building it and returns its raw
+  // text; see detail::skipValue.
+  std::string_view skip_value();
+  static std::string unescape(std::string_view raw);
+
+private:
+  // Throws unless cur_ is at the start of a number.
+  void expectNumber() const;
+
+  iterator_t begin_, cur_, end_;
+};
+// Pull reader: each next() steps to the following token of the input, so
+// hot message types can be decoded field by field without a DOM and
+// without callbacks.
+//
+//   smalljson::JsonReader reader(text);
+//   while (reader.next()) {
+//     if (reader.depth() == 1 && reader.key() == "price")
+//       price = reader.get_double();
+//     else if (reader.token() == smalljson::JsonReader::Token::BeginObject)
+//       reader.skip();
+//   }
+//
+// An object member is reported as its value's token with key() set to
+// the member name; key() is empty inside arrays and on End tokens. The
+// views returned by key() and raw() last until the next call to next().
+// Malformed input throws Exception.
+class JsonReader {
+public:
+  enum class Token {
+    None,
+    BeginObject,
+    EndObject,
+    BeginArray,
+    EndArray,
+    String,
+    Number,
+    Boolean,
+    Null
+  };
+
+  explicit JsonReader(const std::string &input)
+      : begin_(input.data()), cur_(input.data()),
+        end_(input.data() + input.size()) {}
+  // The reader keeps iterators into `input`, so a temporary is refused.
+  explicit JsonReader(std::string &&) = delete;
+  // False once the root value has been read completely.
+  bool next();
+  Token token() const noexcept { return token_; }
+  std::string_view key() const noexcept { return key_; }
+  // Text of a scalar; strings without their quotes and still escaped.
+  std::string_view raw() const noexcept { return raw_; }
+  // Number of containers open at the current token.
+  size_t depth() const noexcept { return stack_.size(); }
+  size_t offset() const noexcept { return cur_ - begin_; }
+  std::string get_string() const;
+  double get_double() const;
+  int64_t get_int64() const;
+  bool get_boolean() const;
+  // On BeginObject or BeginArray, steps over the contents without
+  // tokenizing them and leaves the reader on the matching End token.
+  void skip();
+
+private:
+  typedef Parser::iterator_t iterator_t;
+  bool step();
+  void skipWhitespace();
+  void readKey();
+  void readValue();
+
+  iterator_t begin_, cur_, end_;
+  // '{' or '[' for each open container.
+  std::vector<char> stack_;
+  Token token_ = Token::None;
+  std::string_view key_, raw_;
+  std::string key_buf_;
+  bool escaped_ = false;
+  // Nothing read yet in the innermost container.
+  bool first_ = false;
+};
+
+// Successive roots of concatenated JSON in one buffer: "{..}{..}", or
+// roots separated by whitespace, JSON Lines included. Each root must be
+// an object or array, as for Parser. After next(), offset() is where that
+// root ended, so a connection reader can parse every complete document
+// received so far and carry the rest over to the next read:
+//
+//   std::string pending;
+//   while (read(sock, chunk)) {
+//     pending += chunk;
+//     smalljson::JsonStream stream(pending);
+//     smalljson::Value doc;
+//     while (stream.next(doc))
+//       handle(doc);
+//     pending.erase(0, stream.offset());
+//   }
+//
+// A root cut short by the end of the buffer is not an error: next()
+// returns false with partial() set and offset() at the root's start. Each
+// attempt parses the root from there, so a root much larger than a read
+// is best left until enough has arrived. Malformed input throws Exception
+// with offset() counted from the start of the buffer; there is no
+// resynchronizing after that.
+class JsonStream {
+public:
+  explicit JsonStream(const std::string &input)
+      : begin_(input.data()), cur_(input.data()),
+        end_(input.data() + input.size()) {}
+  // The stream keeps iterators into `input`, so a temporary is refused.
+  explicit JsonStream(std::string &&) = delete;
+  // False once no complete root is left.
+  bool next(Value &value);
+  size_t offset() const noexcept { return cur_ - begin_; }
+  bool partial() const noexcept { return partial_; }
+
+private:
+  typedef Parser::iterator_t iterator_t;
+
+  iterator_t begin_, cur_, end_;
+  bool partial_ = false;
+};
+
+// One node of a FrozenDocument. Nodes are stored in document order; an
+// object's members appear as key (String) node followed by the value's
+// nodes. `next` is the index just past the node's subtree.
+struct FrozenNode {
+  Value::ValueType type = Value::ValueType::Null;
+  uint32_t size = 0;
+  uint32_t next = 0;
+  std::string_view text;
+};
+
+// Read-only view of a node inside a FrozenDocument. Strings and keys are
+// kept in their raw (escaped) form, numbers as their literal text.
+class FrozenValue {
+public:
+  constexpr FrozenValue(const FrozenNode *nodes, uint32_t idx)
+      : nodes_(nodes), idx_(idx) {}
+  constexpr Value::ValueType type() const { return node().type; }
+  constexpr bool isNull() const { return type() == Value::ValueType::Null; }
+  constexpr bool isNumber() const {
+    return type() == Value::ValueType::Number;
+  }
+  constexpr bool isArray() const { return type() == Value::ValueType::Array; }
+  constexpr bool isObject() const {
+    return type() == Value::ValueType::Object;
+  }
+  constexpr bool isString() const {
+    return type() == Value::ValueType::String;
+  }
+  constexpr bool isBoolean() const {
+    return type() == Value::ValueType::Boolean;
+  }
+  constexpr size_t size() const {
+    if (!isArray() && !isObject())
+      throw Exception(Exception::ParseError::BAD_TYPE);
+    return node().size;
+  }
+  constexpr std::string_view raw() const {
+    if (isArray() || isObject())
+      throw Exception(Exception::ParseError::BAD_TYPE);
+    return node().text;
+  }
+  constexpr bool to_boolean() const {
+    if (!isBoolean())
+      throw Exception(Exception::ParseError::BAD_TYPE);
+    return node().text[0] == 't';
+  }
+  constexpr int64_t to_int64() const {
+    std::string_view text = raw();
+    if (!isNumber())
+      throw Exception(Exception::ParseError::BAD_TYPE);
+    bool negative = text[0] == '-';
+    // Accumulated negated, so INT64_MIN fits.
+    int64_t value = 0;
+    for (size_t idx = negative ? 1 : 0; idx < text.size(); idx++) {
+      if (text[idx] < '0' || text[idx] > '9')
+        throw Exception(Exception::ParseError::BAD_TYPE);
+      int digit = text[idx] - '0';
+      if (value < (std::numeric_limits<int64_t>::min() + digit) / 10)
+        throw std::out_of_range("smalljson::FrozenValue::to_int64");
+      value = value * 10 - digit;
+    }
+    if (!negative && value == std::numeric_limits<int64_t>::min())
+      throw std::out_of_range("smalljson::FrozenValue::to_int64");
+    return negative ? value : -value;
+  }
+  constexpr FrozenValue operator[](size_t idx) const {
+    if (!isArray())
+      throw Exception(Exception::ParseError::BAD_TYPE);
+    if (idx >= node().size)
+      throw std::out_of_range("frozen array index");
+    uint32_t child = idx_ + 1;
+    for (; idx > 0; idx--)
+      child = nodes_[child].next;
+    return FrozenValue(nodes_, child);
+  }
+  // A repeated key finds its last occurrence, as Parser keeps it.
+  constexpr FrozenValue operator[](std::string_view key) const {
+    if (!isObject())
+      throw Exception(Exception::ParseError::BAD_TYPE);
+    uint32_t found = 0;
+    for (uint32_t child = idx_ + 1; child < node().next;
+         child = nodes_[child + 1].next) {
+      if (nodes_[child].text == key)
+        found = child + 1;
+    }
+    if (!found)
+      throw std::out_of_range("frozen object key");
+    return FrozenValue(nodes_, found);
+  }
+  std::string to_string() const;
+  Value to_value() const;
+
+private:
+  constexpr const FrozenNode &node() const { return nodes_[idx_]; }
+  const FrozenNode *nodes_;
+  uint32_t idx_;
+};
+
+template <size_t N> class FrozenDocument {
+public:
+  std::array<FrozenNode, N> nodes;
+
+  constexpr FrozenValue root() const { return FrozenValue(nodes.data(), 0); }
+  constexpr FrozenValue operator[](std::string_view key) const {
+    return root()[key];
+  }
+  constexpr FrozenValue operator[](size_t idx) const { return root()[idx]; }
+  Value to_value() const { return root().to_value(); }
+};
+
+namespace detail {
+// Constant-evaluable twin of Parser. With nodes == nullptr it only
+// validates and counts, which sizes the FrozenDocument.
+class LiteralParser {
+public:
+  constexpr LiteralParser(std::string_view json_data, FrozenNode *nodes)
+      : json_(json_data), nodes_(nodes) {}
+
+  constexpr uint32_t parse() {
+    skipWhiteSpace();
+    if (peek() != '{' && peek() != '[')
+      throw Exception(Exception::ParseError::NOT_JSON);
+    parseValue();
+    skipWhiteSpace();
+    if (pos_ != json_.size())
+      throw Exception(Exception::ParseError::ROOT_NOT_ONE);
+    return count_;
+  }
+
+private:
+  constexpr char peek() const {
+    return pos_ < json_.size() ? json_[pos_] : '\0';
+  }
+  constexpr static bool isDigit(char ch) { return ch >= '0' && ch <= '9'; }
+  constexpr void skipWhiteSpace() {
+    while (peek() == ' ' || peek() == '\n' || peek() == '\r' ||
+           peek() == '\t')
+      pos_++;
+  }
+  constexpr void skipDigit() {
+    while (isDigit(peek()))
+      pos_++;
+  }
+  constexpr uint32_t emit(Value::ValueType type, size_t begin, size_t end) {
+    if (nodes_) {
+      nodes_[count_].type = type;
+      nodes_[count_].next = count_ + 1;
+      nodes_[count_].text = json_.substr(begin, end - begin);
+    }
+    return count_++;
+  }
+  constexpr void close(uint32_t idx, uint32_t size) {
+    if (nodes_) {
+      nodes_[idx].size = size;
+      nodes_[idx].next = count_;
+    }
+  }
+  constexpr void parseValue() {
+    switch (peek()) {
+    case '{':
+      return parseObject();
+    case '[':
+      return parseArray();
+    case '"':
+      return parseString();
+    case 't':
+      return parseLiteral("true", Value::ValueType::Boolean,
+                          Exception::ParseError::BAD_BOOLEAN);
+    case 'f':
+      return parseLiteral("false", Value::ValueType::Boolean,
+                          Exception::ParseError::BAD_BOOLEAN);
+    case 'n':
+      return parseLiteral("null", Value::ValueType::Null,
+                          Exception::ParseError::BAD_NULL);
+    default:
+      break;
+    }
+    if (peek() == '-' || isDigit(peek()))
+      return parseNumber();
+    throw Exception(Exception::ParseError::BAD_VALUE);
+  }
+  constexpr void parseObject() {
+    uint32_t idx = emit(Value::ValueType::Object, pos_, pos_);
+    uint32_t size = 0;
+    pos_++;
+    skipWhiteSpace();
+    if (peek() == '}') {
+      pos_++;
+      return close(idx, size);
+    }
+    while (true) {
+      skipWhiteSpace();
+      if (peek() != '"')
+        throw Exception(Exception::ParseError::BAD_KEY);
+      parseString();
+      skipWhiteSpace();
+      if (peek() != ':')
+        throw Exception(Exception::ParseError::MISS_COLON);
+      pos_++;
+      skipWhiteSpace();
+      parseValue();
+      skipWhiteSpace();
+      size++;
+      if (peek() == ',') {
+        pos_++;
+      } else if (peek() == '}') {
+        pos_++;
+        return close(idx, size);
+      } else {
+        throw Exception(Exception::ParseError::LACK_COMMA_OR_BRACE);
+      }
+    }
+  }
+  constexpr void parseArray() {
+    uint32_t idx = emit(Value::ValueType::Array, pos_, pos_);
+    uint32_t size = 0;
+    pos_++;
+    skipWhiteSpace();
+    if (peek() == ']') {
+      pos_++;
+      return close(idx, size);
+    }
+    while (true) {
+      skipWhiteSpace();
+      parseValue();
+      skipWhiteSpace();
+      size++;
+      if (peek() == ',') {
+        pos_++;
+      } else if (peek() == ']') {
+        pos_++;
+        return close(idx, size);
+      } else {
+        throw Exception(Exception::ParseError::LACK_COMMA_OR_BRACKET);
+      }
+    }
+  }
+  constexpr void parseString() {
+    size_t begin = ++pos_;
+    while (pos_ < json_.size() && json_[pos_] != '"') {
+      if (json_[pos_] == '\\') {
+        switch (pos_ + 1 < json_.size() ? json_[pos_ + 1] : '\0') {
+        case '"':
+        case '\\':
+        case '/':
+        case 't':
+        case 'r':
+        case 'n':
+        case 'b':
+        case 'f':
+          pos_++;
+          break;
+        case 'u':
+          parseUnicodeEscape();
+          continue;
+        default:
+          throw Exception(Exception::ParseError::BAD_ESCAPE);
+        }
+      }
+      pos_++;
+    }
+    if (pos_ == json_.size())
+      throw Exception(Exception::ParseError::JSON_LENGTH);
+    emit(Value::ValueType::String, begin, pos_++);
+  }
+  constexpr uint32_t parseHex4(size_t at) const {
+    if (at + 4 > json_.size())
+      throw Exception(Exception::ParseError::BAD_ESCAPE);
+    uint32_t code = 0;
+    for (size_t idx = at; idx < at + 4; idx++) {
+      char ch = json_[idx];
+      uint32_t digit = isDigit(ch)              ? ch - '0'
+                       : ch >= 'a' && ch <= 'f' ? ch - 'a' + 10
+                       : ch >= 'A' && ch <= 'F' ? ch - 'A' + 10
+                                                : 16;
+      if (digit == 16)
+        throw Exception(Exception::ParseError::BAD_ESCAPE);
+      code = code << 4 | digit;
+    }
+    return code;
+  }
+  // \uXXXX at pos_, and the low half after a high surrogate, paired as
+  // detail::unescapeJson pairs them; lone surrogates become U+FFFD there.
+  constexpr void parseUnicodeEscape() {
+    uint32_t code = parseHex4(pos_ + 2);
+    pos_ += 6;
+    if (code >= 0xd800 && code <= 0xdbff &&
+        json_.substr(pos_, 2) == std::string_view("\\u")) {
+      uint32_t low = parseHex4(pos_ + 2);
+      if (low >= 0xdc00 && low <= 0xdfff)
+        pos_ += 6;
+    }
+  }
+  constexpr void parseLiteral(std::string_view literal, Value::ValueType type,
+                              Exception::ParseError err) {
+    if (json_.substr(pos_, literal.size()) != literal)
+      throw Exception(err);
+    emit(type, pos_, pos_ + literal.size());
+    pos_ += literal.size();
+  }
+  constexpr void parseNumber() {
+    size_t begin = pos_;
+    if (peek() == '-')
+      pos_++;
+    if (!isDigit(peek()))
+      throw Exception(Exception::ParseError::BAD_NUMBER);
+    if (peek() == '0' && pos_ + 1 < json_.size() && isDigit(json_[pos_ + 1]))
+      throw Exception(Exception::ParseError::BAD_NUMBER);
+    skipDigit();
+    if (peek() == '.') {
+      pos_++;
+      if (!isDigit(peek()))
+        throw Exception(Exception::ParseError::BAD_NUMBER);
+      skipDigit();
+    }
+    if (peek() == 'e' || peek() == 'E') {
+      pos_++;
+      if (peek() == '+' || peek() == '-')
+        pos_++;
+      if (!isDigit(peek()))
+        throw Exception(Exception::ParseError::BAD_NUMBER);
+      skipDigit();
+    }
+    emit(Value::ValueType::Number, begin, pos_);
+  }
+
+  std::string_view json_;
+  FrozenNode *nodes_;
+  size_t pos_ = 0;
+  uint32_t count_ = 0;
+};
+} // namespace detail
+
+// Number of tape nodes needed for a literal; fails constant evaluation
+// (and so the build) when the literal is not valid JSON.
+constexpr size_t frozenSize(std::string_view json_data) {
+  return detail::LiteralParser(json_data, nullptr).parse();
+}
+
+template <size_t N>
+constexpr FrozenDocument<N> freeze(std::string_view json_data) {
+  FrozenDocument<N> doc{};
+  detail::LiteralParser(json_data, doc.nodes.data()).parse();
+  return doc;
+}
+
+// static constexpr auto config = SMALLJSON_FROZEN(R"({"port": 80})");
+#define SMALLJSON_FROZEN(literal)                                             \
+  ([] {                                                                        \
+    constexpr std::string_view smalljson_literal_ = literal;                   \
+    return ::smalljson::freeze<::smalljson::frozenSize(smalljson_literal_)>(   \
+        smalljson_literal_);                                                   \
+  }())
+
+#if defined(__cpp_nontype_template_args) &&                                    \
+    __cpp_nontype_template_args >= 201911L
+template <FixedString Literal> inline constexpr auto frozen_literal =
+    freeze<frozenSize(Literal.view())>(Literal.view());
+
+namespace literals {
+// auto &config = R"({"port": 80})"_frozen;
+template <FixedString Literal> constexpr const auto &operator""_frozen() {
+  return frozen_literal<Literal>;
+}
+} // namespace literals
+#endif
+} // namespace smalljson
+
+namespace std {
+template <> struct hash<smalljson::Value> {
+  size_t operator()(const smalljson::Value &value) const noexcept {
+    return value.hash();
+  }
 };
-} // namespace smalljson
\ No newline at end of file
+} // namespace std
@@ -0,0 +1,97 @@
+#include "smalljson.h"
+#include <cstdio>
+#include <string>
+
+// Built against a copy of the library compiled with SMALLJSON_COUNT_COPIES:
+// the move-aware mutators must not deep-copy, their copying twins must.
+
+namespace {
+int failures = 0;
+
+#define CHECK(expr)                                                            \
+  do {                                                                         \
+    if (!(expr)) {                                                             \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,   \
+                   #expr);                                                     \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+// Deep copies made by fn.
+template <typename Fn> uint64_t copies(Fn &&fn) {
+  uint64_t before = smalljson::deep_copy_count();
+  fn();
+  return smalljson::deep_copy_count() - before;
+}
+
+smalljson::Value payload() {
+  return smalljson::Parser::parse(R"({"list":[1,2,3],"inner":{"k":"v"}})");
+}
+
+bool allFound(smalljson::Object &obj) {
+  const smalljson::Object &view = obj;
+  for (auto &[name, value] : view) {
+    std::string key = name.str();
+    if (obj.find(key) == obj.end() || view.find(key) == view.end() ||
+        &view.at(smalljson::Key(key)) != &value)
+      return false;
+  }
+  return true;
+}
+} // namespace
+
+int main() {
+  using smalljson::Array;
+  using smalljson::Object;
+  using smalljson::Value;
+
+  // Large enough for a hash index, which the first lookup builds.
+  Object obj;
+  for (int idx = 0; idx < 20; idx++)
+    obj["k" + std::to_string(idx)] = idx;
+  CHECK(allFound(obj));
+
+  Value moved = payload();
+  CHECK(copies([&] {
+          CHECK(obj.try_emplace("fresh", std::move(moved)).second);
+        }) == 0);
+  CHECK(obj.at("fresh").at("list").to_array().size() == 3);
+
+  // An existing key leaves both the member and the argument alone.
+  Value kept = payload();
+  CHECK(copies([&] {
+          CHECK(!obj.try_emplace("k0", std::move(kept)).second);
+        }) == 0);
+  CHECK(obj.at("k0").get<int64_t>() == 0);
+  CHECK(kept.isObject() && kept.at("list").to_array().size() == 3);
+
+  CHECK(copies([&] {
+          CHECK(obj.insert_or_assign("k1", std::move(kept)).second == false);
+        }) == 0);
+  CHECK(obj.at("k1").at("inner").at("k").to_string() == "v");
+  CHECK(copies([&] {
+          CHECK(obj.insert_or_assign("assigned", std::move(payload())).second);
+        }) == 0);
+
+  const Value shared = payload();
+  CHECK(copies([&] { obj.try_emplace("copied", shared); }) > 0);
+  CHECK(copies([&] { obj.insert_or_assign("k2", shared); }) > 0);
+  CHECK(obj.size() == 23);
+  CHECK(allFound(obj));
+
+  Array arr;
+  CHECK(copies([&] { arr.push_back(payload()); }) == 0);
+  Value element = payload();
+  CHECK(copies([&] { arr.push_back(std::move(element)); }) == 0);
+  CHECK(copies([&] { arr.emplace_back(payload()); }) == 0);
+  CHECK(copies([&] { arr.push_back(shared); }) > 0);
+  CHECK(arr.size() == 4);
+
+  // Whole containers: moving is free, copying counts each nested payload.
+  CHECK(copies([&] { Object taken = std::move(obj); }) == 0);
+  CHECK(copies([&] { Value copy = shared; }) == 3);
+  CHECK(copies([&] { Array copy = arr; }) == 1 + 4 * 3);
+
+  std::printf("copy_count %s\n", failures ? "FAILED" : "ok");
+  return failures;
+}
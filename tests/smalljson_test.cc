@@ -0,0 +1,1668 @@
+#include "message_parser.h"
+#include "odd_keys_parser.h"
+#include "smalljson.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+
+// Regression tests, run by ctest. Each case is a function in kTests; CHECK
+// reports the failing expression and carries on, and the exit status is
+// the number of failures.
+
+namespace {
+int failures = 0;
+
+#define CHECK(expr)                                                            \
+  do {                                                                         \
+    if (!(expr)) {                                                             \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,   \
+                   #expr);                                                     \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+// The parse error `fn` throws, or nullopt when it returns.
+template <typename Fn>
+std::optional<smalljson::Exception::ParseError> parseError(Fn &&fn) {
+  try {
+    fn();
+  } catch (const smalljson::Exception &err) {
+    return err.error();
+  }
+  return std::nullopt;
+}
+
+void testCodegenEscapedKey() {
+  Message msg = Message::parse(R"({"name":"bob","id":7})");
+  CHECK(msg.name == "bob");
+  CHECK(msg.id == 7);
+  CHECK(msg.extra.empty());
+  // Escaped spellings of a known key dispatch to its member, as Parser
+  // maps them to the same key.
+  const std::string escaped = R"({"na\u006de":"bob","id":8})";
+  msg = Message::parse(escaped);
+  CHECK(msg.name == "bob");
+  CHECK(msg.id == 8);
+  CHECK(msg.extra.empty());
+  CHECK(smalljson::Parser::parse(escaped).at("name").to_string() == "bob");
+  // Unknown keys land in extra decoded once, as Parser stores them.
+  msg = Message::parse(R"({"x\\u0041":1,"y":2})");
+  CHECK(msg.extra.find("x\\u0041") != msg.extra.end());
+  CHECK(msg.extra.find("y") != msg.extra.end());
+}
+
+void testCodegenOddKeys() {
+  // Keys needing escapes in the generated literals dispatch to their
+  // members, whichever way the input spells them.
+  const std::string text =
+      R"({"line\nbreak":1,"tab\u0009here":2,"bell\u0007":3,"nul\u0000":4,)"
+      R"("del\u007f9":5,"quote\"back\\":6,"nul":7})";
+  OddKeys keys = OddKeys::parse(text);
+  CHECK(keys.line_break == 1);
+  CHECK(keys.tab_here == 2);
+  CHECK(keys.bell_ == 3);
+  CHECK(keys.nul_ == 4);
+  CHECK(keys.del_9 == 5);
+  CHECK(keys.quote_back_ == 6);
+  CHECK(keys.extra.size() == 1);
+  CHECK(keys.extra.find(std::string("nul")) != keys.extra.end());
+  // Keys that map to the same identifier, or to one the struct uses
+  // itself, get suffixed members in key order.
+  keys = OddKeys::parse(
+      R"({"a-b":1,"a_b":2,"extra":3,"extra_":4,"OddKeys":5,"parse":6})");
+  CHECK(keys.a_b == 1);
+  CHECK(keys.a_b_2 == 2);
+  CHECK(keys.extra_ == 3);
+  CHECK(keys.extra__2 == 4);
+  CHECK(keys.OddKeys_2 == 5);
+  CHECK(keys.parse_ == 6);
+  CHECK(keys.extra.empty());
+}
+
+void testCursorNumberGrammar() {
+  using smalljson::Exception;
+  auto readInt = [](const std::string &text) {
+    return smalljson::Cursor(text).read_int64();
+  };
+  auto readDouble = [](const std::string &text) {
+    return smalljson::Cursor(text).read_double();
+  };
+  CHECK(readInt(" -42") == -42);
+  CHECK(readDouble("2.5e1") == 25.0);
+  CHECK(readDouble("7") == 7.0);
+  // Cursor and JsonReader take the numbers Parser takes and reject the
+  // rest the same way.
+  for (const char *bad : {"-inf", "inf", "007", "1.", "-", "1e", "+1", ".5"}) {
+    const std::string array = std::string("[") + bad + "]";
+    auto parsed = parseError([&] { smalljson::Parser::parse(array); });
+    CHECK(parsed.has_value());
+    CHECK(parseError([&] { readInt(bad); }) == parsed);
+    CHECK(parseError([&] { readDouble(bad); }) == parsed);
+    CHECK(parseError([&] {
+            smalljson::JsonReader reader(array);
+            while (reader.next()) {
+            }
+          }) == parsed);
+  }
+  CHECK(parseError([&] { readInt("1.5"); }) ==
+        Exception::ParseError::BAD_NUMBER);
+  CHECK(parseError([&] { readInt("99999999999999999999"); }) ==
+        Exception::ParseError::BAD_NUMBER);
+  CHECK(parseError([&] { Message::parse(R"({"id":007})"); }) ==
+        Exception::ParseError::BAD_NUMBER);
+  CHECK(parseError([&] { Message::parse(R"({"score":-inf})"); }) ==
+        Exception::ParseError::BAD_NUMBER);
+  CHECK(parseError([&] { Message::parse(R"({"score":1.})"); }) ==
+        Exception::ParseError::BAD_NUMBER);
+  CHECK(parseError([&] { Message::parse(R"({"id":"7"})"); }) ==
+        Exception::ParseError::BAD_TYPE);
+}
+
+void testOutOfRangeDoubles() {
+  const std::string text = "[1e400,-1e400,1e-400,-1e-400,0.0001e-330]";
+  const double expected[] = {HUGE_VAL, -HUGE_VAL, 0.0, -0.0, 0.0};
+  smalljson::Value binary = smalljson::Parser::parse(text);
+  smalljson::Value lossless =
+      smalljson::Parser::parse(text, smalljson::NumberMode::Lossless);
+  smalljson::Document doc = smalljson::Document::parse(text);
+  for (size_t idx = 0; idx < std::size(expected); idx++) {
+    for (const smalljson::Value *root : {&binary, &lossless, &doc.root()}) {
+      const smalljson::Value &num = root->at(idx);
+      CHECK(num.get<double>() == expected[idx]);
+      CHECK(std::signbit(*num.get<double>()) == std::signbit(expected[idx]));
+      CHECK(num.to_double() == expected[idx]);
+      // Lossless keeps 1e-400 as text, which is not the double 0.0.
+      if (root != &lossless) {
+        CHECK(num == smalljson::Value(expected[idx]));
+        CHECK(num.hash() == smalljson::Value(expected[idx]).hash());
+      }
+    }
+  }
+  CHECK(binary.at(size_t(0)).get_if<double>() != nullptr);
+  const std::string huge = "-1e400";
+  CHECK(smalljson::Cursor(huge).read_double() == -HUGE_VAL);
+}
+
+void testBigIntegers() {
+  const std::string text = "[12345678901234567890,18446744073709551615,"
+                           "18446744073709551616,-9223372036854775809]";
+  smalljson::Document doc = smalljson::Document::parse(text);
+  smalljson::Value copy = doc.root();
+  smalljson::Value lossless =
+      smalljson::Parser::parse(text, smalljson::NumberMode::Lossless);
+  for (const smalljson::Value *root : {&doc.root(), &copy, &lossless}) {
+    CHECK(root->at(size_t(0)).get<uint64_t>() == 12345678901234567890u);
+    CHECK(root->at(size_t(1)).get<uint64_t>() == UINT64_MAX);
+    CHECK(!root->at(size_t(2)).get<uint64_t>());
+    CHECK(!root->at(size_t(3)).get<int64_t>());
+    CHECK(!root->at(size_t(0)).get<int64_t>());
+  }
+  CHECK(copy.to_print() == doc.root().to_print());
+}
+
+constexpr std::string_view kFrozenText =
+    R"({"a":1,"a":2,"s":"\u00e9\ud83d\ude00","max":9223372036854775807,)"
+    R"("min":-9223372036854775808,"big":9223372036854775808})";
+
+void testFrozenLiterals() {
+  using smalljson::Exception;
+  static_assert(smalljson::frozenSize(R"(["\ud83d\ude00","\ud800x"])") == 3);
+  constexpr auto doc = SMALLJSON_FROZEN(kFrozenText);
+  static_assert(doc["a"].to_int64() == 2);
+  static_assert(doc["max"].to_int64() == INT64_MAX);
+  static_assert(doc["min"].to_int64() == INT64_MIN);
+  bool overflow = false;
+  try {
+    doc["big"].to_int64();
+  } catch (const std::out_of_range &) {
+    overflow = true;
+  }
+  CHECK(overflow);
+  smalljson::Value value = doc.to_value();
+  CHECK(value == smalljson::Parser::parse(std::string(kFrozenText)));
+  CHECK(value.at("a").get<int64_t>() == 2);
+  CHECK(value.at("s").to_string() == "\u00e9\U0001F600");
+  // Constant evaluation rejects these; at run time the same checks throw.
+  for (const char *bad :
+       {R"(["\uZZZZ"])", R"(["\u12"])", R"(["\ud800\u12"])"})
+    CHECK(parseError([&] { smalljson::frozenSize(bad); }) ==
+          Exception::ParseError::BAD_ESCAPE);
+}
+
+void testNdjsonBatch() {
+  std::vector<smalljson::Value> records;
+  for (int idx = 0; idx < 1000; idx++)
+    records.push_back(smalljson::Parser::parse(
+        R"({"id":)" + std::to_string(idx) + R"(,"tags":["a","b"]})"));
+  std::ostringstream serial, batched;
+  {
+    smalljson::NdjsonWriter writer(serial);
+    for (const smalljson::Value &record : records)
+      writer.write(record);
+    writer.flush();
+  }
+  {
+    smalljson::NdjsonWriter writer(batched, 4096, true);
+    writer.write_batch(records, 4);
+    writer.flush();
+  }
+  CHECK(!serial.str().empty());
+  CHECK(batched.str() == serial.str());
+}
+
+void testQuerySinglePass() {
+  using Op = smalljson::Query::Op;
+  const std::string ndjson =
+      R"({"s":"a","n":1,"o":{"x":[10,{"y":2}]},"g":[1, 2]})" "\n"
+      R"({"n":2,"s":"b","o":{"x":[20]},"g":[1,2],"extra":{"deep":[[]]}})" "\n"
+      "\n"
+      R"({"s":"a","\u006e":3,"o":{"x":[30,{"y":5}],"z":null},"g":{"k":"v"}})"
+      "\n"
+      R"({"s":"c","n":4,"n":100,"o":[],"g":"a\/b"})" "\n"
+      R"({"g":"a/b","s":"c","o":{"x":[1,{"y":1}]}})" "\n";
+  smalljson::Query query;
+  query.where("/n", Op::Ge, 2)
+      .where("/s", Op::Ne, "b")
+      .group_by("/g")
+      .metric("/o/x/1/y")
+      .metric("/n")
+      .metric("/o/x/0");
+  auto result = query.run(ndjson, 1);
+  // Records 3 and 4 pass; the repeated "n" resolves at its first
+  // occurrence, and "\u006e" names "n".
+  CHECK(result.size() == 2);
+  auto obj = result.find(R"({"k":"v"})");
+  CHECK(obj != result.end());
+  if (obj != result.end()) {
+    CHECK(obj->second.count == 1);
+    CHECK(obj->second.metrics[0].sum == 5);
+    CHECK(obj->second.metrics[1].sum == 3);
+    CHECK(obj->second.metrics[2].sum == 30);
+  }
+  auto str = result.find(R"("a/b")");
+  CHECK(str != result.end());
+  if (str != result.end()) {
+    CHECK(str->second.count == 1);
+    CHECK(str->second.metrics[0].count == 0);
+    CHECK(str->second.metrics[1].sum == 4);
+  }
+
+  // Against JsonPointer::find on the parsed records, one field at a time
+  // and all together; whitespace in containers does not split groups.
+  smalljson::Query all;
+  all.where("/o", Op::Exists).group_by("/g").metric("/o/x/0");
+  auto grouped = all.run(ndjson, 1);
+  std::map<std::string, std::pair<uint64_t, double>> expected;
+  std::istringstream lines(ndjson);
+  for (std::string line; std::getline(lines, line);) {
+    if (line.empty())
+      continue;
+    smalljson::Value record = smalljson::Parser::parse(line);
+    if (!smalljson::JsonPointer("/o").find(record))
+      continue;
+    const smalljson::Value *group = smalljson::JsonPointer("/g").find(record);
+    auto &[count, sum] = expected[group ? group->to_print() : "null"];
+    count++;
+    if (auto *x0 = smalljson::JsonPointer("/o/x/0").find(record))
+      sum += x0->to_double();
+  }
+  CHECK(grouped.size() == expected.size());
+  for (auto &[key, totals] : expected) {
+    auto iter = grouped.find(key);
+    CHECK(iter != grouped.end());
+    if (iter != grouped.end()) {
+      CHECK(iter->second.count == totals.first);
+      CHECK(iter->second.metrics[0].sum == totals.second);
+    }
+  }
+
+  smalljson::Query root;
+  root.where("", Op::Exists).group_by("/o/x");
+  CHECK(root.run(R"({"o":{"x":[1, 2]}})").count("[1,2]") == 1);
+  CHECK(parseError([&] { root.run("{\"o\":1}\n{\"o\" 1}\n", 1); }) ==
+        smalljson::Exception::ParseError::MISS_COLON);
+}
+
+void testRunParts() {
+  std::vector<int> ran(8);
+  bool thrown = false;
+  try {
+    smalljson::detail::runParts(8, [&](unsigned part) {
+      ran[part]++;
+      if (part % 3 == 2)
+        throw std::runtime_error("part " + std::to_string(part));
+    });
+  } catch (const std::runtime_error &err) {
+    thrown = std::string(err.what()) == "part 2";
+  }
+  CHECK(thrown);
+  CHECK(ran == std::vector<int>(8, 1));
+  smalljson::detail::runParts(0, [&](unsigned) { ran[0]++; });
+  CHECK(ran[0] == 1);
+}
+
+void testArenaOwnership() {
+  auto arena = std::make_unique<smalljson::Arena>();
+  std::vector<void *> blocks;
+  {
+    smalljson::ArenaScope scope(*arena);
+    blocks.push_back(smalljson::detail::allocate(64));
+    // Big enough for a chunk of its own.
+    blocks.push_back(smalljson::detail::allocate(size_t(4) << 20));
+  }
+  for (void *block : blocks)
+    CHECK(arena->owns(block));
+  // Heap memory freed while the arena is alive, and arena memory freed on
+  // another thread, each go where they belong; the sanitizers object
+  // otherwise.
+  std::thread other([&] {
+    smalljson::Value heap = smalljson::Parser::parse(
+        R"({"a long enough key to leave the inline buffer": [1, 2, 3]})");
+    smalljson::detail::deallocate(blocks[0], 64);
+    smalljson::detail::deallocate(blocks[1], size_t(4) << 20);
+  });
+  other.join();
+  smalljson::Document doc = smalljson::Document::parse(
+      R"({"a long enough key to leave the inline buffer": [1, 2, 3]})",
+      smalljson::Arena::Options());
+  CHECK(doc.root().to_print() ==
+        R"({"a long enough key to leave the inline buffer":[1,2,3]})");
+  doc = smalljson::Document();
+  arena.reset();
+  void *heap = smalljson::detail::allocate(64);
+  smalljson::detail::deallocate(heap, 64);
+}
+
+void testJsonStream() {
+  // The stream borrows its buffer, so it cannot be built from a temporary.
+  static_assert(!std::is_constructible_v<smalljson::JsonStream, std::string>);
+  const std::string text = "{\"a\":1}\n[2]\n{\"b\":";
+  smalljson::JsonStream stream(text);
+  smalljson::Value value;
+  std::string roots;
+  while (stream.next(value))
+    roots += value.to_print();
+  CHECK(roots == "{\"a\":1}[2]");
+  CHECK(stream.partial());
+  CHECK(stream.offset() == text.find("{\"b\""));
+}
+
+struct CommentOptions : smalljson::ParseOptions {
+  static constexpr bool comments = true;
+};
+
+struct StrictOptions : smalljson::ParseOptions {
+  static constexpr bool validate_utf8 = true;
+  static constexpr unsigned max_depth = 4;
+  static constexpr smalljson::DuplicateKeys duplicate_keys =
+      smalljson::DuplicateKeys::Reject;
+};
+
+struct UnlimitedOptions : smalljson::ParseOptions {
+  static constexpr unsigned max_depth = 0;
+};
+
+void testParseOptions() {
+  using smalljson::Exception;
+  using smalljson::Parser;
+  using smalljson::RelaxedParseOptions;
+  auto error = [](auto parse) { return parseError(parse); };
+
+  const std::string commented = "/* head */ [1, // one\n 2 /* two */]\n// end";
+  CHECK(Parser::parse<CommentOptions>(commented).to_print() == "[1,2]");
+  CHECK(Parser::parse<RelaxedParseOptions>(commented).to_print() == "[1,2]");
+  CHECK(error([&] { Parser::parse(commented); }) ==
+        Exception::ParseError::NOT_JSON);
+  CHECK(error([&] { Parser::parse<CommentOptions>("[1 /* open]"); }) ==
+        Exception::ParseError::BAD_COMMENT);
+  CHECK(error([&] { Parser::parse<CommentOptions>("[1 / 2]"); }) ==
+        Exception::ParseError::BAD_COMMENT);
+
+  for (const char *text : {"[1,2,]", R"({"a":1,})"}) {
+    CHECK(Parser::parse<RelaxedParseOptions>(text).to_print() ==
+          Parser::parse<RelaxedParseOptions>(
+              std::string(text).erase(std::strlen(text) - 2, 1))
+              .to_print());
+    // Not with comments alone.
+    CHECK(error([&] { Parser::parse<CommentOptions>(text); }).has_value());
+  }
+  CHECK(error([&] { Parser::parse("[1,2,]"); }) ==
+        Exception::ParseError::BAD_VALUE);
+  CHECK(error([&] { Parser::parse(R"({"a":1,})"); }) ==
+        Exception::ParseError::BAD_KEY);
+  CHECK(error([&] { Parser::parse<RelaxedParseOptions>("[1,,2]"); }) ==
+        Exception::ParseError::BAD_VALUE);
+
+  smalljson::Value special =
+      Parser::parse<RelaxedParseOptions>("[NaN, Infinity, -Infinity, -1]");
+  CHECK(std::isnan(*special.at(size_t(0)).get<double>()));
+  CHECK(special.at(size_t(1)).get<double>() == HUGE_VAL);
+  CHECK(special.at(size_t(2)).get<double>() == -HUGE_VAL);
+  CHECK(special.at(size_t(3)).get<int64_t>() == -1);
+  CHECK(error([&] { Parser::parse("[NaN]"); }) ==
+        Exception::ParseError::BAD_VALUE);
+  CHECK(error([&] { Parser::parse("[-Infinity]"); }) ==
+        Exception::ParseError::BAD_NUMBER);
+  CHECK(error([&] { Parser::parse<RelaxedParseOptions>("[Inf]"); }) ==
+        Exception::ParseError::BAD_NUMBER);
+
+  // Raw invalid bytes and a truncated sequence; escapes decode to valid
+  // UTF-8, lone surrogates included (as U+FFFD).
+  for (const char *bad : {"[\"\xff\"]", "[\"\xe2\x82\"]", "{\"\xc0\xaf\":1}"}) {
+    CHECK(Parser::parse(bad).type() != smalljson::Value::ValueType::Null);
+    CHECK(error([&] { Parser::parse<StrictOptions>(bad); }) ==
+          Exception::ParseError::BAD_UTF8);
+  }
+  smalljson::Value valid =
+      Parser::parse<StrictOptions>("[\"\\u20ac\\ud800\", \"\xe2\x82\xac\"]");
+  CHECK(valid.at(size_t(0)).to_string() == "\u20ac\ufffd");
+  CHECK(valid.at(size_t(1)).to_string() == "\u20ac");
+
+  CHECK(Parser::parse<StrictOptions>("[[[[1]]]]").to_print() == "[[[[1]]]]");
+  CHECK(error([&] { Parser::parse<StrictOptions>("[[[[[1]]]]]"); }) ==
+        Exception::ParseError::TOO_DEEP);
+  CHECK(error([&] { Parser::parse<StrictOptions>(R"({"a":1,"a":2})"); }) ==
+        Exception::ParseError::DUPLICATE_KEY);
+
+  // The default limit sits at 1024 levels, counting objects and arrays.
+  auto nested = [](size_t depth) {
+    std::string text;
+    for (size_t idx = 0; idx < depth; idx++)
+      text += idx % 2 ? R"({"k":)" : "[";
+    text += "0";
+    for (size_t idx = depth; idx-- > 0;)
+      text += idx % 2 ? "}" : "]";
+    return text;
+  };
+  CHECK(smalljson::ParseOptions::max_depth == 1024);
+  CHECK(Parser::parse(nested(1024)).isArray());
+  CHECK(error([&] { Parser::parse(nested(1025)); }) ==
+        Exception::ParseError::TOO_DEEP);
+  CHECK(error([&] { smalljson::Document::parse(nested(1025)); }) ==
+        Exception::ParseError::TOO_DEEP);
+  CHECK(Parser::parse<UnlimitedOptions>(nested(1100)).isArray());
+
+  smalljson::Document doc =
+      smalljson::Document::parse<RelaxedParseOptions>(commented);
+  CHECK(doc.root().to_print() == "[1,2]");
+  CHECK(error([&] {
+          smalljson::Document::parse<StrictOptions>("[[[[[]]]]]");
+        }) == Exception::ParseError::TOO_DEEP);
+}
+
+// Whether `obj` keeps a hash index: the bytes it uses beyond a copy
+// without one.
+bool hasIndex(const smalljson::Object &obj) {
+  smalljson::Object plain = obj;
+  plain.set_hash_index(smalljson::HashIndex::Never);
+  return obj.memory_usage() > plain.memory_usage();
+}
+
+// Every lookup form finds what `expected` holds, and nothing else, on the
+// object and on a const view of it.
+bool sameMembers(smalljson::Object &obj,
+                 const std::map<std::string, int64_t> &expected) {
+  const smalljson::Object &view = obj;
+  bool same = obj.size() == expected.size();
+  for (auto &[name, num] : expected) {
+    std::string_view key = name;
+    auto iter = obj.find(name);
+    same = same && iter != obj.end() && iter->second.get<int64_t>() == num &&
+           obj.find(smalljson::Key(key)) == iter &&
+           view.find(name) == smalljson::Object::const_iterator(iter) &&
+           view.find(smalljson::Key(key)) ==
+               smalljson::Object::const_iterator(iter) &&
+           &view.at(smalljson::Key(key)) == &iter->second &&
+           &obj.at(name) == &iter->second;
+  }
+  for (int idx = 0; idx < 64; idx++) {
+    std::string name = "missing" + std::to_string(idx);
+    same = same && obj.find(name) == obj.end() &&
+           view.find(smalljson::Key(name)) == view.end() &&
+           expected.count(name) == 0;
+  }
+  return same;
+}
+
+void testObjectIndex() {
+  using smalljson::HashIndex;
+  using smalljson::Object;
+  const size_t threshold = Object::kIndexThreshold;
+  Object obj;
+  std::map<std::string, int64_t> expected;
+  // Up across the threshold, one insert at a time. The index is built by
+  // the first non-const lookup that finds the object at the threshold.
+  for (size_t idx = 0; idx < threshold + 8; idx++) {
+    std::string name = "key" + std::to_string(idx);
+    obj[name] = int64_t(idx);
+    expected[name] = int64_t(idx);
+    CHECK(sameMembers(obj, expected));
+    CHECK(hasIndex(obj) == (obj.size() >= threshold));
+  }
+  // And back down: the index outlives the crossing until tombstones make
+  // compactIndex() run, which drops it.
+  while (obj.size() > 4) {
+    std::string name = expected.begin()->first;
+    CHECK(obj.erase(name) == 1);
+    CHECK(obj.erase(name) == 0);
+    expected.erase(name);
+    CHECK(sameMembers(obj, expected));
+  }
+  CHECK(!hasIndex(obj));
+
+  // Interleaved erase, insert and find on an indexed object, long enough
+  // for tombstones to fill the table many times over.
+  std::mt19937 rng(7);
+  for (size_t idx = 0; idx < 40; idx++) {
+    obj["churn" + std::to_string(idx)] = int64_t(idx);
+    expected["churn" + std::to_string(idx)] = int64_t(idx);
+  }
+  size_t fresh = Object(obj).memory_usage();
+  for (int round = 0; round < 3000; round++) {
+    auto victim = expected.begin();
+    std::advance(victim, rng() % expected.size());
+    if (rng() % 2) {
+      obj.erase(obj.find(victim->first));
+    } else {
+      auto first = obj.find(victim->first);
+      obj.erase(first, std::next(first));
+    }
+    expected.erase(victim);
+    std::string name = "churn" + std::to_string(40 + round);
+    CHECK(obj.try_emplace(name, int64_t(round)).second);
+    expected[name] = round;
+    if (round % 100 == 0)
+      CHECK(sameMembers(obj, expected));
+  }
+  CHECK(sameMembers(obj, expected));
+  CHECK(hasIndex(obj));
+  CHECK(obj.memory_usage() <= 2 * fresh);
+
+  // The policy, fixed up front or changed on a live object.
+  Object always({{"a", 1}});
+  always.set_hash_index(HashIndex::Always);
+  CHECK(always.hash_index() == HashIndex::Always);
+  CHECK(hasIndex(always));
+  CHECK(sameMembers(always, {{"a", 1}}));
+  CHECK(always.erase("a") == 1);
+  CHECK(sameMembers(always, {}));
+  always["b"] = 2;
+  CHECK(sameMembers(always, {{"b", 2}}));
+
+  obj.set_hash_index(HashIndex::Never);
+  CHECK(!hasIndex(obj));
+  CHECK(sameMembers(obj, expected));
+  obj.erase(obj.begin());
+  expected.erase(expected.begin());
+  obj["late"] = -1;
+  expected["late"] = -1;
+  CHECK(!hasIndex(obj));
+  CHECK(sameMembers(obj, expected));
+  obj.set_hash_index(HashIndex::Auto);
+  CHECK(hasIndex(obj));
+  CHECK(sameMembers(obj, expected));
+
+  // Parsed objects follow ParseOptions::hash_index.
+  std::string text = "{";
+  for (size_t idx = 0; idx < threshold; idx++)
+    text += (idx ? ",\"" : "\"") + std::to_string(idx) + "\":0";
+  smalljson::Value parsed = smalljson::Parser::parse(text + "}");
+  CHECK(hasIndex(parsed.to_object()));
+  parsed.to_object().erase("0");
+  CHECK(parsed.to_object().find(std::string("1")) !=
+        parsed.to_object().end());
+}
+
+// Whether `fn` throws std::logic_error.
+template <typename Fn> bool logicError(Fn &&fn) {
+  try {
+    fn();
+  } catch (const std::logic_error &) {
+    return true;
+  }
+  return false;
+}
+
+// Takes a chain of single-member containers apart from the top, which the
+// recursive destructor cannot do for deep chains, and returns its length.
+// The innermost value is left in `last`.
+size_t unchain(smalljson::Value cur, smalljson::Value &last) {
+  size_t levels = 0;
+  for (;; levels++) {
+    smalljson::Value next;
+    if (cur.isArray() && cur.to_array().size() == 1)
+      next = std::move(cur.to_array()[0]);
+    else if (cur.isObject() && cur.to_object().size() == 1)
+      next = std::move(cur.to_object().begin()->second);
+    else
+      break;
+    cur = std::move(next);
+  }
+  last = std::move(cur);
+  return levels;
+}
+
+void testBuilder() {
+  using smalljson::Builder;
+  // Keys in map order, so Value::to_print() writes the same bytes.
+  Builder b;
+  b.begin_object().key("a").begin_array();
+  b.value(nullptr).value(true).value(false).value(-7).value(2.5);
+  b.value(uint64_t(18446744073709551615u)).value("q\"\\\n\x01");
+  b.begin_array().end_array().begin_object().end_object().end_array();
+  b.key("b").begin_object().key("c").value("d").end_object();
+  b.key("e").value(std::string(40, 'x')).end_object();
+  CHECK(b.complete());
+  smalljson::Value built = b.build();
+  CHECK(b.to_print() == built.to_print());
+  CHECK(built == smalljson::Parser::parse(b.to_print()));
+  CHECK(built["a"][5].to_print() == "18446744073709551615");
+  CHECK(built["a"][6].to_string() == "q\"\\\n\x01");
+  CHECK(built["a"][7].isArray() && built["a"][8].isObject());
+  CHECK(built["b"]["c"].to_string() == "d");
+
+  // Feeding a Value back in reproduces it.
+  Builder again;
+  again.value(built);
+  CHECK(again.to_print() == built.to_print());
+  CHECK(again.build() == built);
+  Builder scalar;
+  scalar.value("only");
+  CHECK(scalar.build().to_string() == "only");
+  CHECK(scalar.to_print() == "\"only\"");
+
+  // Nesting far deeper than the C stack would allow for a recursive build.
+  const size_t depth = 100000;
+  Builder deep;
+  for (size_t idx = 0; idx < depth; idx++)
+    idx % 2 ? deep.begin_object().key("k") : deep.begin_array();
+  deep.value(1);
+  for (size_t idx = depth; idx-- > 0;)
+    idx % 2 ? deep.end_object() : deep.end_array();
+  std::string text = deep.to_print();
+  CHECK(text.size() == depth * 2 + depth / 2 * 4 + 1);
+  smalljson::Value innermost;
+  CHECK(unchain(deep.build(), innermost) == depth);
+  CHECK(innermost.get<int64_t>() == 1);
+
+  // Every misuse throws std::logic_error.
+  CHECK(logicError([] { Builder().build(); }));
+  CHECK(logicError([] { Builder().to_print(); }));
+  CHECK(logicError([] { Builder().begin_array().build(); }));
+  CHECK(logicError([] { Builder().begin_object().to_print(); }));
+  CHECK(logicError([] { Builder().value(1).value(2); }));
+  CHECK(logicError([] { Builder().value(1).begin_array(); }));
+  CHECK(logicError([] { Builder().begin_object().value(1); }));
+  CHECK(logicError([] { Builder().begin_object().begin_array(); }));
+  CHECK(logicError([] { Builder().key("a"); }));
+  CHECK(logicError([] { Builder().begin_array().key("a"); }));
+  CHECK(logicError([] { Builder().begin_object().key("a").key("b"); }));
+  CHECK(logicError([] { Builder().end_array(); }));
+  CHECK(logicError([] { Builder().begin_array().end_object(); }));
+  CHECK(logicError([] { Builder().begin_object().end_array(); }));
+  CHECK(logicError([] { Builder().begin_object().key("a").end_object(); }));
+  CHECK(logicError([] { Builder().value(1).end_array(); }));
+  // clear() makes a finished builder reusable.
+  Builder reused;
+  reused.value(1);
+  reused.clear();
+  CHECK(!reused.complete());
+  reused.begin_array().value(2).end_array();
+  CHECK(reused.to_print() == "[2]");
+}
+
+struct Record {
+  int64_t id;
+  std::string name;
+  std::optional<double> score;
+  std::optional<std::string> note;
+  std::vector<std::string> tags;
+  std::map<std::string, int> counts;
+  std::vector<std::vector<int>> grid;
+  uint64_t big;
+};
+
+void testWriterMatchesBuilder() {
+  const std::vector<Record> records = {
+      {1, "plain", 2.5, "n", {"a", "b"}, {{"x", 1}, {"y", -2}},
+       {{1, 2}, {}, {3}}, 18446744073709551615u},
+      {-2, std::string("ctl\x01\x1f\t\n\"\\\x7f", 10), std::nullopt,
+       std::nullopt, {}, {}, {}, 0},
+      {3, "\xc3\xa9t\xc3\xa9", -0.125, "", {""}, {{"", 0}}, {{}}, 42},
+  };
+  // Keys in map order, so Value::to_print() writes the same bytes.
+  std::string written;
+  smalljson::Writer writer(written);
+  writer.array([&] {
+    for (const Record &rec : records) {
+      writer.object([&] {
+        writer.field("big", rec.big).field("counts", rec.counts);
+        writer.field("grid", rec.grid).field("id", rec.id);
+        writer.field("name", rec.name).field("note", rec.note);
+        writer.field("score", rec.score).field("tags", rec.tags);
+      });
+    }
+  });
+
+  smalljson::Builder builder;
+  builder.begin_array();
+  for (const Record &rec : records) {
+    builder.begin_object().key("big").value(rec.big);
+    builder.key("counts").begin_object();
+    for (auto &[name, count] : rec.counts)
+      builder.key(name).value(count);
+    builder.end_object().key("grid").begin_array();
+    for (auto &row : rec.grid) {
+      builder.begin_array();
+      for (int cell : row)
+        builder.value(cell);
+      builder.end_array();
+    }
+    builder.end_array().key("id").value(rec.id).key("name").value(rec.name);
+    builder.key("note");
+    rec.note ? builder.value(*rec.note) : builder.value(nullptr);
+    builder.key("score");
+    rec.score ? builder.value(*rec.score) : builder.value(nullptr);
+    builder.key("tags").begin_array();
+    for (auto &tag : rec.tags)
+      builder.value(tag);
+    builder.end_array().end_object();
+  }
+  builder.end_array();
+
+  CHECK(written == builder.to_print());
+  // Lossless, so the integer past INT64_MAX keeps its digits.
+  smalljson::Value parsed =
+      smalljson::Parser::parse(written, smalljson::NumberMode::Lossless);
+  CHECK(written == parsed.to_print());
+  CHECK(written == builder.build().to_print());
+  CHECK(parsed[1]["name"].to_string() == records[1].name);
+  CHECK(written.find("\"ctl\\u0001\\u001f\\t\\n\\\"\\\\\x7f\"") !=
+        std::string::npos);
+
+  // Values nested through a Writer print as themselves, and separators
+  // stay right around them.
+  std::string mixed;
+  smalljson::Writer mixed_writer(mixed);
+  mixed_writer.array([&] {
+    mixed_writer.value(parsed[0]).value(parsed.to_array()).value(nullptr);
+    mixed_writer.array([] {}).object([] {}).value(true);
+  });
+  CHECK(mixed == "[" + parsed[0].to_print() + "," + parsed.to_print() +
+                     ",null,[],{},true]");
+  CHECK(smalljson::Parser::parse(mixed, smalljson::NumberMode::Lossless)
+            .to_print() == mixed);
+}
+
+struct Point {
+  int x, y;
+  bool operator==(const Point &rhs) const {
+    return x == rhs.x && y == rhs.y;
+  }
+};
+} // namespace
+
+template <> struct smalljson::JsonTraits<Point> {
+  static Value to_json(const Point &p) { return Array{p.x, p.y}; }
+  static Point from_json(const Value &value) {
+    auto [x, y] = smalljson::from_json<std::pair<int, int>>(value);
+    return Point{x, y};
+  }
+};
+
+namespace {
+// `value` through to_json, to_print, the parser and from_json again. The
+// text is wrapped in an array, as the parser wants a container at the root.
+template <typename T> bool roundTrips(const T &value) {
+  smalljson::Value json = smalljson::to_json(value);
+  smalljson::Value parsed =
+      smalljson::Parser::parse("[" + json.to_print() + "]");
+  return smalljson::from_json<T>(json) == value &&
+         smalljson::from_json<T>(parsed.at(size_t(0))) == value;
+}
+
+void testJsonTraits() {
+  using smalljson::from_json;
+  using smalljson::to_json;
+  CHECK(roundTrips(std::optional<int>(3)));
+  CHECK(roundTrips(std::optional<int>()));
+  CHECK(to_json(std::optional<int>()).isNull());
+  CHECK(roundTrips(std::pair<std::string, int>("a", 1)));
+  CHECK(roundTrips(std::tuple<int, bool, std::string, double>(-1, true,
+                                                               "t", 0.5)));
+  CHECK(to_json(std::make_tuple(1, "x")).to_print() == R"([1,"x"])");
+  CHECK(roundTrips(std::vector<int>{1, 2, 3}));
+  CHECK(roundTrips(std::vector<int>{}));
+  CHECK(roundTrips(std::vector<bool>{true, false}));
+  CHECK(roundTrips(std::array<double, 3>{0.5, -1, 1e300}));
+  CHECK(roundTrips(std::map<std::string, std::vector<int>>{
+      {"a", {1}}, {"b", {}}}));
+  CHECK(roundTrips(std::unordered_map<std::string, std::optional<int>>{
+      {"x", 1}, {"y", std::nullopt}}));
+  CHECK(to_json(std::map<std::string, int>{{"b", 2}, {"a", 1}}).to_print() ==
+        R"({"a":1,"b":2})");
+  CHECK(roundTrips(std::vector<std::optional<std::string>>{"s", {}}));
+
+  // A user specialization nested in standard containers.
+  CHECK(to_json(Point{1, 2}).to_print() == "[1,2]");
+  CHECK(roundTrips(std::vector<Point>{{1, 2}, {3, 4}}));
+  CHECK(roundTrips(std::map<std::string, std::vector<Point>>{
+      {"path", {{0, 0}, {5, -5}}}}));
+  CHECK(roundTrips(std::optional<std::pair<Point, std::string>>(
+      std::make_pair(Point{7, 8}, "p"))));
+
+  // Shape and range mismatches throw BAD_TYPE.
+  auto error = [](const std::string &text, auto type) {
+    smalljson::Value value = smalljson::Parser::parse("[" + text + "]");
+    return parseError(
+        [&] { from_json<decltype(type)>(value.at(size_t(0))); });
+  };
+  const auto bad_type = smalljson::Exception::ParseError::BAD_TYPE;
+  CHECK(error("[1,2,3]", std::tuple<int, int>()) == bad_type);
+  CHECK(error("[1]", std::tuple<int, int>()) == bad_type);
+  CHECK(error("[1,2]", std::tuple<int, int>()) == std::nullopt);
+  CHECK(error("[1,2,3]", std::pair<int, int>()) == bad_type);
+  CHECK(error("[1]", std::array<int, 2>()) == bad_type);
+  CHECK(error("127", int8_t()) == std::nullopt);
+  CHECK(error("128", int8_t()) == bad_type);
+  CHECK(error("-129", int8_t()) == bad_type);
+  CHECK(error("[1,300]", std::vector<int8_t>()) == bad_type);
+  CHECK(error("-1", uint8_t()) == bad_type);
+  CHECK(error("\"1\"", int()) == bad_type);
+  CHECK(error("{}", std::vector<int>()) == bad_type);
+  CHECK(error("[]", std::map<std::string, int>()) == bad_type);
+  CHECK(error("[1,2,3]", Point()) == bad_type);
+  CHECK(error(R"({"p":[1,"2"]})", std::map<std::string, Point>()) ==
+        bad_type);
+  CHECK(error("[null,1]", std::vector<std::optional<int>>()) ==
+        std::nullopt);
+}
+
+// The exception `fn` throws; fails the test when there is none.
+template <typename Fn> smalljson::Exception thrown(Fn &&fn) {
+  try {
+    fn();
+  } catch (const smalljson::Exception &err) {
+    return err;
+  }
+  CHECK(!"no exception");
+  return smalljson::Exception(smalljson::Exception::ParseError::NOT_JSON);
+}
+
+void testErrorLocation() {
+  using smalljson::Exception;
+  struct Case {
+    std::string input;
+    Exception::ParseError error;
+    size_t offset, line, column;
+    const char *snippet;
+    size_t caret;
+  };
+  const Case cases[] = {
+      // First line.
+      {R"({"a":tru})", Exception::ParseError::BAD_BOOLEAN, 5, 1, 6,
+       R"({"a":tru})", 5},
+      // A later line; the snippet is that line alone.
+      {"{\n  \"a\": 1,\n  \"b\": x\n}", Exception::ParseError::BAD_VALUE, 19,
+       3, 8, "  \"b\": x", 7},
+      // CRLF line endings; the '\r' stays out of the snippet.
+      {"  [1,\r\n 2 ] 3", Exception::ParseError::ROOT_NOT_ONE, 12, 2, 6,
+       " 2 ] 3", 5},
+      // At EOF the caret sits one past the snippet.
+      {"[1,2", Exception::ParseError::LACK_COMMA_OR_BRACKET, 4, 1, 5, "[1,2",
+       4},
+      {"{\"a\":1}\n\n  ,", Exception::ParseError::ROOT_NOT_ONE, 11, 3, 3,
+       "  ,", 2},
+  };
+  for (const Case &test : cases) {
+    const std::string &in = test.input;
+    const Exception errors[] = {
+        thrown([&] { smalljson::Parser::parse(in); }),
+        thrown([&] { smalljson::Document::parse(in); }),
+        thrown([&] { smalljson::Parser::parse_keys(in, {"a", "b"}); }),
+        thrown([&] {
+          smalljson::JsonReader reader(in);
+          while (reader.next()) {
+          }
+        }),
+    };
+    for (const Exception &err : errors) {
+      CHECK(err.error() == test.error);
+      CHECK(err.offset() == test.offset);
+      Exception::Location loc = err.locate(in);
+      CHECK(loc.line == test.line);
+      CHECK(loc.column == test.column);
+      CHECK(loc.snippet == test.snippet);
+      CHECK(loc.caret == test.caret);
+    }
+  }
+
+  // context bounds the snippet on both sides of the offending byte.
+  const std::string wide = "[" + std::string(100, '1') + "x]";
+  Exception err = thrown([&] { smalljson::Parser::parse(wide); });
+  CHECK(err.offset() == 101);
+  Exception::Location loc = err.locate(wide, 4);
+  CHECK(loc.column == 102);
+  CHECK(loc.snippet == "1111x]");
+  CHECK(loc.caret == 4);
+
+  // Errors not tied to an input have no offset; locate() then points at
+  // the end of whatever text it is given.
+  err = thrown([] { smalljson::from_json<int>(smalljson::Value("x")); });
+  CHECK(err.error() == Exception::ParseError::BAD_TYPE);
+  CHECK(err.offset() == Exception::npos);
+  loc = err.locate("ab\ncd");
+  CHECK(loc.line == 2);
+  CHECK(loc.column == 3);
+  CHECK(loc.snippet == "cd");
+  CHECK(loc.caret == 2);
+  CHECK(Exception(Exception::ParseError::BAD_KEY).offset() ==
+        Exception::npos);
+}
+
+void testParseMany() {
+  using smalljson::Exception;
+  // Views into one buffer with no terminator between them: each input is
+  // parsed in place and must end where its view does.
+  std::string joined;
+  std::vector<size_t> starts;
+  for (int idx = 0; idx < 600; idx++) {
+    starts.push_back(joined.size());
+    if (idx == 100)
+      joined += "[tru]";
+    else if (idx == 450)
+      joined += "[nul]";
+    else if (idx == 451)
+      joined += "[1]  ]";
+    else
+      joined += "[" + std::to_string(idx) + "]";
+  }
+  starts.push_back(joined.size());
+  std::vector<std::string_view> inputs;
+  for (size_t idx = 0; idx + 1 < starts.size(); idx++)
+    inputs.push_back(std::string_view(joined).substr(
+        starts[idx], starts[idx + 1] - starts[idx]));
+
+  // Two threads split the batch at 300, so the failures at 450 and 451
+  // come from the other thread.
+  for (unsigned threads : {1u, 2u}) {
+    std::vector<smalljson::Value> out(7);
+    Exception err = thrown(
+        [&] { smalljson::Parser::parse_many(inputs, out, threads); });
+    // The lowest-index failure wins, whichever thread finished first.
+    CHECK(err.error() == Exception::ParseError::BAD_BOOLEAN);
+    CHECK(err.offset() == 1);
+    CHECK(out.size() == inputs.size());
+    for (size_t idx = 0; idx < out.size(); idx++) {
+      if (idx == 100 || idx == 450 || idx == 451)
+        CHECK(out[idx].isNull());
+      else
+        CHECK(out[idx].to_print() == "[" + std::to_string(idx) + "]");
+    }
+  }
+
+  // Without failures nothing is thrown, and an empty batch empties out.
+  inputs.resize(100);
+  std::vector<smalljson::Value> out;
+  smalljson::Parser::parse_many(inputs, out, 2);
+  CHECK(out.size() == 100 && out[99].to_print() == "[99]");
+  smalljson::Parser::parse_many({}, out);
+  CHECK(out.empty());
+}
+
+// Parser::parse(text) with only the root members named in `keys`.
+smalljson::Value selectKeys(const std::string &text,
+                           const std::vector<std::string_view> &keys) {
+  smalljson::Value all = smalljson::Parser::parse(text);
+  smalljson::Object picked;
+  for (auto &[name, item] : all.to_object()) {
+    for (std::string_view key : keys) {
+      if (name.view() == key) {
+        picked.insert_or_assign(name.str(), item);
+        break;
+      }
+    }
+  }
+  return picked;
+}
+
+void testParseKeys() {
+  using smalljson::Parser;
+  const std::vector<std::string> docs = {
+      R"({"a":1,"b":{"a":2,"c":[3]},"c":"x"})",
+      // Brackets and escaped quotes inside skipped strings.
+      R"({"s":"]}[{","t":"\"]\\","u":["\"[",{"v":"}"}],"a":1})",
+      // Escaped spellings of a requested key.
+      R"({"a":1,"b\"":2,"b\\":3})",
+      // Duplicates: the last one wins, as in Parser.
+      R"({"a":1,"b":2,"a":3,"a":{"z":[]}})",
+      R"({ "a" : [ 1 , 2 ] , "b" : "" , "c" : null })",
+      R"({})",
+  };
+  const std::vector<std::vector<std::string_view>> key_sets = {
+      {"a"}, {"a", "b"}, {"missing"}, {"a", "a"}, {"b\"", "b\\"}, {},
+  };
+  for (const std::string &doc : docs) {
+    for (const auto &keys : key_sets)
+      CHECK(Parser::parse_keys(doc, keys) == selectKeys(doc, keys));
+  }
+  // Only the root is filtered: a requested key keeps all of its members,
+  // and a key nested under a skipped member is not picked up.
+  smalljson::Value nested =
+      Parser::parse_keys(R"({"n":{"x":1,"y":2},"m":{"k":3}})", {"n", "k"});
+  CHECK(nested.to_print() == R"({"n":{"x":1,"y":2}})");
+
+  // Escapes straddling a 64-byte block of the skipped-container scan, at
+  // every alignment. The skipped text must end exactly where it should.
+  for (size_t pad = 0; pad < 140; pad++) {
+    for (const char *tail : {R"(\"])", R"(\\)", R"(\\\"x)", R"(])"}) {
+      const std::string skipped =
+          "[\"" + std::string(pad, 'x') + tail + "\",\"]\"]";
+      const std::string doc = "{\"s\":" + skipped + ",\"a\":[\"]\"]}";
+      CHECK(Parser::parse_keys(doc, {"a"}).to_print() == R"({"a":["]"]})");
+      CHECK(Parser::parse_keys(doc, {"s"}) == selectKeys(doc, {"s"}));
+      smalljson::Cursor cursor(doc);
+      cursor.expect('{', smalljson::Exception::ParseError::NOT_JSON);
+      CHECK(cursor.read_key() == "s");
+      cursor.expect(':', smalljson::Exception::ParseError::MISS_COLON);
+      CHECK(cursor.skip_value() == skipped);
+      CHECK(cursor.consume(','));
+    }
+  }
+  const std::string scalar_text = R"( "a\"b" , 12.5e1 ,true])";
+  smalljson::Cursor scalars(scalar_text);
+  CHECK(scalars.skip_value() == R"("a\"b")");
+  CHECK(scalars.consume(','));
+  CHECK(scalars.skip_value() == "12.5e1");
+  CHECK(scalars.consume(','));
+  CHECK(scalars.skip_value() == "true");
+
+  // A skipped value cut short is an error, not a read past the end.
+  const auto short_error = smalljson::Exception::ParseError::JSON_LENGTH;
+  CHECK(parseError([] {
+          Parser::parse_keys(R"({"s":["]",{"x":1})", {"a"});
+        }) == short_error);
+  CHECK(parseError([] { Parser::parse_keys(R"({"s":"abc\")", {"a"}); }) ==
+        short_error);
+
+  // With comments on, skipped values are parsed properly, so a bracket or
+  // quote inside a comment does not throw the scan off.
+  const std::string commented = R"({"s":[1, /* ] " */ 2] // }
+    ,"t":{"k": // "
+      3}, "a":1})";
+  CHECK(Parser::parse_keys<CommentOptions>(commented, {"a"}).to_print() ==
+        R"({"a":1})");
+  CHECK(Parser::parse_keys<smalljson::RelaxedParseOptions>(commented,
+                                                            {"s", "t"})
+            .to_print() == R"({"s":[1,2],"t":{"k":3}})");
+  CHECK(parseError([&] { Parser::parse_keys(commented, {"a"}); }));
+}
+
+void testValueEquality() {
+  using smalljson::NumberMode;
+  using smalljson::Parser;
+  // Numbers compare by value, whatever their spelling or representation.
+  for (NumberMode mode : {NumberMode::Binary, NumberMode::Lossless}) {
+    smalljson::Value nums = Parser::parse("[1,1.0,1e0,10e-1,1.5,2]", mode);
+    for (size_t idx = 1; idx < 4; idx++) {
+      CHECK(nums[idx] == nums[0]);
+      CHECK(nums[idx].hash() == nums[0].hash());
+      CHECK(std::hash<smalljson::Value>()(nums[idx]) == nums[0].hash());
+    }
+    CHECK(nums[4] != nums[0]);
+    CHECK(nums[5] != nums[0]);
+  }
+  CHECK(smalljson::Value(int64_t(1)) == smalljson::Value(1.0));
+  CHECK(smalljson::Value(int64_t(1)).hash() == smalljson::Value(1.0).hash());
+  // Numbers never equal strings or booleans with the same text.
+  smalljson::Value mixed = Parser::parse(R"([1,"1",true,"true",null])");
+  CHECK(mixed[0] != mixed[1]);
+  CHECK(mixed[2] != mixed[3]);
+  CHECK(mixed[4] == smalljson::Value());
+
+  // Objects are equal whatever the order of their members in the text.
+  smalljson::Value lhs = Parser::parse(R"({"a":1,"b":[1,{"x":2,"y":3}]})");
+  smalljson::Value rhs = Parser::parse(R"({"b":[1.0,{"y":3,"x":2}],"a":1})");
+  CHECK(lhs == rhs);
+  CHECK(lhs.hash() == rhs.hash());
+  CHECK(lhs != Parser::parse(R"({"a":1,"b":[{"x":2,"y":3},1]})"));
+  CHECK(lhs != Parser::parse(R"({"a":1,"b":[1,{"x":2,"y":3}],"c":0})"));
+  CHECK(lhs != Parser::parse(R"({"a":1,"c":[1,{"x":2,"y":3}]})"));
+  // With and without a hash index.
+  smalljson::Value wide = Parser::parse(R"({"b":[1,{"y":3,"x":2}],"a":1})");
+  wide.to_object().set_hash_index(smalljson::HashIndex::Always);
+  CHECK(wide == lhs);
+
+  // memory_usage grows as containers do, and counts long strings only.
+  smalljson::Value tree = Parser::parse(R"({"list":[],"map":{}})");
+  size_t before = tree.memory_usage();
+  CHECK(before > 0);
+  tree["list"].to_array().push_back(smalljson::Value(int64_t(1)));
+  size_t grown = tree.memory_usage();
+  CHECK(grown > before);
+  for (int idx = 0; idx < 100; idx++)
+    tree["list"].to_array().push_back(smalljson::Value(int64_t(idx)));
+  CHECK(tree.memory_usage() > grown);
+  grown = tree.memory_usage();
+  tree["map"].to_object().insert_or_assign("k", smalljson::Value("short"));
+  CHECK(tree.memory_usage() > grown);
+  grown = tree.memory_usage();
+  tree["map"]["k"] = smalljson::Value(std::string(100, 's'));
+  CHECK(tree.memory_usage() >= grown + 100);
+  CHECK(smalljson::Value("short").memory_usage() == 0);
+  CHECK(smalljson::Value(std::string(100, 's')).memory_usage() >= 100);
+}
+
+template <smalljson::DuplicateKeys Keys>
+struct KeysOptions : smalljson::ParseOptions {
+  static constexpr smalljson::DuplicateKeys duplicate_keys = Keys;
+};
+
+constexpr std::string_view kDuplicateText =
+    R"({"a":1,"b":{"c":2,"c":3},"a":[4],"d":5})";
+
+void testDuplicateKeys() {
+  using smalljson::DuplicateKeys;
+  using smalljson::Exception;
+  using smalljson::Parser;
+  const std::string text(kDuplicateText);
+  const std::string first = R"({"a":1,"b":{"c":2},"d":5})";
+  const std::string last = R"({"a":[4],"b":{"c":3},"d":5})";
+  using First = KeysOptions<DuplicateKeys::FirstWins>;
+  using Last = KeysOptions<DuplicateKeys::LastWins>;
+  using Reject = KeysOptions<DuplicateKeys::Reject>;
+
+  CHECK(Parser::parse(text).to_print() == last);
+  CHECK(Parser::parse(text, DuplicateKeys::FirstWins).to_print() == first);
+  CHECK(Parser::parse(text, DuplicateKeys::LastWins).to_print() == last);
+  CHECK(Parser::parse<First>(text).to_print() == first);
+  CHECK(Parser::parse<Last>(text).to_print() == last);
+  CHECK(smalljson::Document::parse(text).root().to_print() == last);
+  CHECK(smalljson::Document::parse(text, DuplicateKeys::FirstWins)
+            .root()
+            .to_print() == first);
+  CHECK(smalljson::Document::parse<First>(text).root().to_print() == first);
+  CHECK(smalljson::Document::parse<Last>(text).root().to_print() == last);
+  CHECK(Parser::parse_keys<First>(text, {"a", "b"}).to_print() ==
+        R"({"a":1,"b":{"c":2}})");
+  CHECK(Parser::parse_keys<Last>(text, {"a", "b"}).to_print() ==
+        R"({"a":[4],"b":{"c":3}})");
+  // A FrozenDocument keeps every occurrence; lookups find the last one.
+  constexpr auto frozen = SMALLJSON_FROZEN(kDuplicateText);
+  static_assert(frozen.root().size() == 4);
+  static_assert(frozen["a"].isArray());
+  static_assert(frozen["b"]["c"].to_int64() == 3);
+  CHECK(frozen.to_value().to_print() == last);
+
+  // Reject points at the repeated key, at the root and nested.
+  const size_t root_dup = text.find(R"("a":[4])");
+  const size_t nested_dup = text.find(R"("c":3)");
+  auto rejected = [](auto &&fn) {
+    Exception err = thrown(fn);
+    CHECK(err.error() == Exception::ParseError::DUPLICATE_KEY);
+    return err.offset();
+  };
+  CHECK(rejected([&] { Parser::parse(text, DuplicateKeys::Reject); }) ==
+        nested_dup);
+  CHECK(rejected([&] { Parser::parse<Reject>(text); }) == nested_dup);
+  CHECK(rejected([&] {
+          smalljson::Document::parse(text, DuplicateKeys::Reject);
+        }) == nested_dup);
+  CHECK(rejected([&] { smalljson::Document::parse<Reject>(text); }) ==
+        nested_dup);
+  CHECK(rejected([&] { Parser::parse_keys<Reject>(text, {"a"}); }) ==
+        root_dup);
+  CHECK(rejected([&] { Parser::parse_keys<Reject>(text, {"b"}); }) ==
+        nested_dup);
+  Exception err = thrown([&] { Parser::parse<Reject>(text); });
+  CHECK(err.locate(text).snippet.substr(err.locate(text).caret) ==
+        R"("c":3},"a":[4],"d":5})");
+  // Members parse_keys skips are not checked.
+  CHECK(Parser::parse_keys<Reject>(text, {"d"}).to_print() == R"({"d":5})");
+  CHECK(Parser::parse<Reject>(R"({"a":{"a":1},"b":[{"a":2},{"a":3}]})")
+            .isObject());
+}
+
+// Whether `str` keeps its bytes inside the object.
+bool isInline(const smalljson::String &str) {
+  const char *self = reinterpret_cast<const char *>(&str);
+  return str.data() >= self && str.data() < self + sizeof(str);
+}
+
+void testStringStorage() {
+  using smalljson::String;
+  // Up to kInlineCapacity bytes inline, one more on the heap; copies and
+  // moves keep content, storage and flags.
+  for (size_t len : {size_t(0), size_t(1), String::kInlineCapacity,
+                     String::kInlineCapacity + 1, size_t(100)}) {
+    const std::string text(len, 'q');
+    String str(text);
+    bool small = len <= String::kInlineCapacity;
+    CHECK(str.view() == text);
+    CHECK(isInline(str) == small);
+    String copy = str;
+    CHECK(copy == str && isInline(copy) == small);
+    String moved = std::move(copy);
+    CHECK(moved == str && isInline(moved) == small);
+    CHECK(copy.empty() && isInline(copy));
+    String assigned("x");
+    assigned = moved;
+    CHECK(assigned == str && isInline(assigned) == small);
+    CHECK(smalljson::Value(text).memory_usage() == (small ? 0 : len));
+  }
+  // Parsed strings and keys either side of the boundary.
+  const std::string k22(22, 'k'), k23(23, 'k'), v22(22, 'v'), v23(23, 'v');
+  smalljson::Value parsed = smalljson::Parser::parse(
+      "{\"" + k22 + "\":\"" + v22 + "\",\"" + k23 + "\":\"" + v23 + "\"}");
+  auto &obj = parsed.to_object();
+  CHECK(obj.size() == 2);
+  for (auto &[name, item] : obj) {
+    bool small = name.size() == 22;
+    CHECK(isInline(name) == small);
+    CHECK(isInline(*item.get_if<String>()) == small);
+  }
+  CHECK(parsed[k22].to_string() == v22 && parsed[k23].to_string() == v23);
+  // An escape that decodes to fewer bytes can bring a string inline.
+  smalljson::Value shrunk =
+      smalljson::Parser::parse("[\"" + std::string(21, 'a') + "\\u00e9\"]");
+  CHECK(shrunk[0].to_string().size() == 23);
+  CHECK(!isInline(*shrunk[0].get_if<String>()));
+  shrunk = smalljson::Parser::parse("[\"" + std::string(20, 'a') +
+                                    "\\u00e9\"]");
+  CHECK(isInline(*shrunk[0].get_if<String>()));
+
+  // HasEscapes: bytes to_print must escape, i.e. '"', '\\' and controls.
+  for (const char *plain : {"", "plain", "caf\xc3\xa9", "\x7f", "/"})
+    CHECK(!String(plain).has_escapes());
+  for (std::string_view needs : {std::string_view("a\"b"), {"a\\b"},
+                                 {"\x01"}, {"\n"}, {"\x1f"}, {"\0x", 2}})
+    CHECK(String(needs).has_escapes());
+  CHECK(String(std::string(30, 'x') + "\t").has_escapes());
+  // ValidUtf8: well-formed sequences only.
+  for (const char *valid :
+       {"", "ascii", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80",
+        "\xf4\x8f\xbf\xbf", "\xed\x9f\xbf"})
+    CHECK(String(valid).valid_utf8());
+  for (const char *invalid :
+       {"\xc3", "\xc3x", "\xc0\x80", "\xe0\x80\x80", "\xed\xa0\x80",
+        "\xf4\x90\x80\x80", "\xf5\x80\x80\x80", "\xff", "\x80", "ok\xe2\x82"})
+    CHECK(!String(invalid).valid_utf8());
+  CHECK(!String(std::string(30, 'x') + "\xff").valid_utf8());
+  // Flags survive copies and moves, inline and on the heap.
+  for (std::string text : {std::string("\xff\n"), std::string(40, 'x') +
+                                                      "\xff\n"}) {
+    String str(text);
+    String copy = str, moved = String(text);
+    for (const String *each : {&str, &copy, &moved})
+      CHECK(each->has_escapes() && !each->valid_utf8());
+  }
+  // The parser flags the decoded content.
+  smalljson::Value flagged = smalljson::Parser::parse(
+      R"(["a\nb","\u00e9","\"","\u0041","\/"," \u0001"])");
+  const bool escapes[] = {true, false, true, false, false, true};
+  for (size_t idx = 0; idx < 6; idx++) {
+    const String &str = *flagged[idx].get_if<String>();
+    CHECK(str.has_escapes() == escapes[idx]);
+    CHECK(str.valid_utf8());
+  }
+  CHECK(!smalljson::Parser::parse("[\"\xff\"]")[0].get_if<String>()
+             ->valid_utf8());
+
+  // \uXXXX escapes: surrogate pairs make one code point; a lone or
+  // mismatched surrogate decodes to U+FFFD.
+  const std::pair<const char *, const char *> decoded[] = {
+      {R"(["\ud83d\ude00"])", "\xf0\x9f\x98\x80"},
+      {R"(["\uD83D\uDE00x"])", "\xf0\x9f\x98\x80x"},
+      {R"(["\udbff\udfff"])", "\xf4\x8f\xbf\xbf"},
+      {R"(["\u0024\u00a2\u20ac"])", "$\xc2\xa2\xe2\x82\xac"},
+      {R"(["\ud800x"])", "\xef\xbf\xbdx"},
+      {R"(["\ude00"])", "\xef\xbf\xbd"},
+      {R"(["\ud83d"])", "\xef\xbf\xbd"},
+      {R"(["\ud83d\u0041"])", "\xef\xbf\xbd" "A"},
+      {R"(["\ud83d\ud83d\ude00"])", "\xef\xbf\xbd\xf0\x9f\x98\x80"},
+  };
+  for (auto [json, bytes] : decoded) {
+    smalljson::Value value = smalljson::Parser::parse(json);
+    CHECK(value[0].to_string() == bytes);
+    CHECK(value[0].get_if<String>()->valid_utf8());
+  }
+}
+
+void testKeyLookups() {
+  using namespace smalljson::literals;
+  // Below and above the hash index threshold, so both lookup paths run.
+  for (size_t size : {size_t(3), smalljson::Object::kIndexThreshold + 4}) {
+    std::string text = R"({"id":-1,"a\u0000b":-2,"":-3)";
+    for (size_t idx = 3; idx < size; idx++)
+      text += ",\"m" + std::to_string(idx) + "\":" + std::to_string(idx);
+    smalljson::Value value = smalljson::Parser::parse(text + "}");
+    smalljson::Object &obj = value.to_object();
+    const smalljson::Object &cobj = obj;
+    CHECK(obj.find("id"_key) == obj.find(std::string("id")));
+    CHECK(obj.find("id"_key)->second.get<int64_t>() == -1);
+    CHECK(cobj.find("id"_key) == cobj.find(std::string("id")));
+    CHECK(obj.find("a\0b"_key) == obj.find(std::string("a\0b", 3)));
+    CHECK(obj.at("a\0b"_key).get<int64_t>() == -2);
+    CHECK(obj.find("a"_key) == obj.end());
+    CHECK(obj.at(""_key).get<int64_t>() == -3);
+    for (size_t idx = 3; idx < size; idx++) {
+      const std::string name = "m" + std::to_string(idx);
+      smalljson::Key key(name);
+      CHECK(obj.find(key) == obj.find(name));
+      CHECK(&cobj.at(key) == &cobj.at(name));
+      CHECK(&value[key] == &value[name]);
+      CHECK(&value.at(key) == &value.at(name));
+    }
+    CHECK(obj.find("missing"_key) == obj.end());
+    CHECK(cobj.find("missing"_key) == cobj.end());
+    bool missing = false;
+    try {
+      cobj.at("missing"_key);
+    } catch (const std::out_of_range &) {
+      missing = true;
+    }
+    CHECK(missing);
+    // operator[] with a Key inserts like the string form.
+    size_t before = obj.size();
+    value["fresh"_key] = smalljson::Value(int64_t(7));
+    CHECK(obj.size() == before + 1);
+    CHECK(obj.find(std::string("fresh"))->second.get<int64_t>() == 7);
+    CHECK(obj.find("fresh"_key) == obj.find(std::string("fresh")));
+#if defined(__cpp_nontype_template_args) &&                                    \
+    __cpp_nontype_template_args >= 201911L
+    static_assert(smalljson::key<"id">.hash == "id"_key.hash);
+    static_assert(smalljson::key<"id">.name == "id");
+    CHECK(obj.find(smalljson::key<"id">) == obj.find(std::string("id")));
+    CHECK(&value[smalljson::key<"fresh">] == &value["fresh"_key]);
+    CHECK(cobj.find(smalljson::key<"missing">) == cobj.end());
+#endif
+  }
+}
+
+void testTypedGet() {
+  // Every storage a number can have: binary, Lossless text, a Document's
+  // lazy Number, and a copy of that.
+  const std::string text =
+      "[3000000000,3e9,2147483647,2147483648,-2147483648,-2147483649,"
+      "-1,18446744073709551615,18446744073709551616,1.5,2.0,"
+      "123456789012345678901234567890,9007199254740993,-0.0]";
+  const smalljson::Document doc = smalljson::Document::parse(text);
+  const smalljson::Value roots[] = {
+      smalljson::Parser::parse(text),
+      smalljson::Parser::parse(text, smalljson::NumberMode::Lossless),
+      doc.root(),
+  };
+  for (const smalljson::Value *root : {&roots[0], &roots[1], &roots[2],
+                                       &doc.root()}) {
+    auto num = [&](size_t idx) -> const smalljson::Value & {
+      return root->at(idx);
+    };
+    // Integer targets: exact or nothing.
+    CHECK(!num(0).get<int32_t>());
+    CHECK(!num(1).get<int32_t>());
+    CHECK(num(0).get<uint32_t>() == 3000000000u);
+    CHECK(num(1).get<int64_t>() == 3000000000);
+    CHECK(num(2).get<int32_t>() == INT32_MAX);
+    CHECK(!num(3).get<int32_t>());
+    CHECK(num(4).get<int32_t>() == INT32_MIN);
+    CHECK(!num(5).get<int32_t>());
+    CHECK(!num(6).get<uint64_t>());
+    CHECK(!num(6).get<uint8_t>());
+    CHECK(num(6).get<int8_t>() == -1);
+    // Binary mode stores integers past int64_t as the nearest double
+    // (2^64 here); the other forms keep the digits.
+    if (root == &roots[0])
+      CHECK(!num(7).get<uint64_t>());
+    else
+      CHECK(num(7).get<uint64_t>() == UINT64_MAX);
+    CHECK(!num(7).get<int64_t>());
+    CHECK(!num(8).get<uint64_t>());
+    CHECK(!num(9).get<int64_t>());
+    CHECK(num(10).get<int>() == 2);
+    CHECK(!num(11).get<int64_t>() && !num(11).get<uint64_t>());
+    CHECK(num(12).get<int64_t>() == 9007199254740993);
+    // Floating targets take the nearest value, however large the integer.
+    CHECK(num(0).get<double>() == 3e9);
+    CHECK(num(7).get<double>() == 18446744073709551616.0);
+    CHECK(num(8).get<double>() == 18446744073709551616.0);
+    CHECK(num(11).get<double>() ==
+          std::strtod("123456789012345678901234567890", nullptr));
+    CHECK(num(12).get<double>() == 9007199254740992.0);
+    CHECK(num(12).get<float>() == 9007199254740992.0f);
+    CHECK(num(9).get<float>() == 1.5f);
+    CHECK(num(13).get<double>() == 0.0);
+    CHECK(num(13).get<int>() == 0);
+  }
+  // Non-numbers never convert.
+  smalljson::Value other = smalljson::Parser::parse(R"(["1",true,null,[]])");
+  for (size_t idx = 0; idx < 4; idx++)
+    CHECK(!other[idx].get<int>() && !other[idx].get<double>());
+}
+
+void testWalk() {
+  smalljson::Value root = smalljson::Parser::parse(
+      R"({"b":[1,[2,3],{"x":4}],"a":{"y":[5]},"c":6})");
+  // Pre-order: a value before its children, siblings in order (members in
+  // key order), with the depth of each.
+  std::vector<std::pair<std::string, size_t>> seen;
+  smalljson::walk(root, [&](const smalljson::Value &value, size_t depth) {
+    seen.emplace_back(value.to_print(), depth);
+  });
+  const std::vector<std::pair<std::string, size_t>> preorder = {
+      {root.to_print(), 0},
+      {R"({"y":[5]})", 1},
+      {"[5]", 2},
+      {"5", 3},
+      {R"([1,[2,3],{"x":4}])", 1},
+      {"1", 2},
+      {"[2,3]", 2},
+      {"2", 3},
+      {"3", 3},
+      {R"({"x":4})", 2},
+      {"4", 3},
+      {"6", 1},
+  };
+  CHECK(seen == preorder);
+
+  // Returning false skips the children of that value only.
+  seen.clear();
+  smalljson::walk(root, [&](const smalljson::Value &value, size_t depth) {
+    seen.emplace_back(value.to_print(), depth);
+    return !value.isArray();
+  });
+  const std::vector<std::pair<std::string, size_t>> pruned = {
+      {root.to_print(), 0},
+      {R"({"y":[5]})", 1},
+      {"[5]", 2},
+      {R"([1,[2,3],{"x":4}])", 1},
+      {"6", 1},
+  };
+  CHECK(seen == pruned);
+  size_t visits = 0;
+  smalljson::walk(root, [&](const smalljson::Value &, size_t) {
+    visits++;
+    return false;
+  });
+  CHECK(visits == 1);
+
+  // Scalar and empty roots are visited once.
+  for (const smalljson::Value &single :
+       {smalljson::Value(int64_t(1)), smalljson::Value(),
+        smalljson::Parser::parse("[]"), smalljson::Parser::parse("{}")}) {
+    visits = 0;
+    smalljson::walk(single, [&](const smalljson::Value &, size_t depth) {
+      visits++;
+      CHECK(depth == 0);
+    });
+    CHECK(visits == 1);
+  }
+
+  // The stack is explicit, so depth is not bounded by the call stack.
+  smalljson::Builder builder;
+  for (size_t idx = 0; idx < 100000; idx++)
+    builder.begin_array();
+  builder.value(0);
+  for (size_t idx = 0; idx < 100000; idx++)
+    builder.end_array();
+  smalljson::Value deep = builder.build();
+  size_t max_depth = 0;
+  smalljson::walk(deep, [&](const smalljson::Value &, size_t depth) {
+    max_depth = std::max(max_depth, depth);
+  });
+  CHECK(max_depth == 100000);
+  smalljson::Value innermost;
+  CHECK(unchain(std::move(deep), innermost) == 100000);
+}
+
+// Everything a JsonReader reports about its current token.
+std::tuple<smalljson::JsonReader::Token, size_t, std::string, std::string,
+           size_t>
+readerState(const smalljson::JsonReader &reader) {
+  return {reader.token(), reader.depth(), std::string(reader.key()),
+          std::string(reader.raw()), reader.offset()};
+}
+
+void testJsonReader() {
+  using Token = smalljson::JsonReader::Token;
+  const std::string docs[] = {
+      R"({"a":{"b":[1,{"c":true}]},"d":null})",
+      R"( [ 1 , -2.5e3 , "s\"\\é😀" , [ ] , { } , false ] )",
+      R"({"":0,"kA":"v","dup":1,"dup":[2],"n":{"m":{"o":[[{}]]}}})",
+      R"([9223372036854775807,-9223372036854775808,1e400,0.1,)"
+      R"(12345678901234567890])",
+      "{\n\t\"x\" :\r\n [\"]\" , \"}\"]\n}",
+  };
+  for (const std::string &doc : docs) {
+    // Rebuild the document from the token stream alone.
+    smalljson::JsonReader reader(doc);
+    smalljson::Builder builder;
+    std::vector<bool> in_object;
+    while (reader.next()) {
+      Token token = reader.token();
+      if (token == Token::EndObject || token == Token::EndArray) {
+        CHECK(reader.key().empty());
+        CHECK(in_object.back() == (token == Token::EndObject));
+        in_object.pop_back();
+        token == Token::EndObject ? builder.end_object() : builder.end_array();
+        CHECK(reader.depth() == in_object.size());
+        continue;
+      }
+      if (!in_object.empty() && in_object.back())
+        builder.key(reader.key());
+      else
+        CHECK(reader.key().empty());
+      switch (token) {
+      case Token::BeginObject:
+      case Token::BeginArray:
+        in_object.push_back(token == Token::BeginObject);
+        token == Token::BeginObject ? builder.begin_object()
+                                    : builder.begin_array();
+        CHECK(reader.depth() == in_object.size());
+        continue;
+      case Token::String:
+        builder.value(reader.get_string());
+        break;
+      case Token::Number: {
+        std::string_view raw = reader.raw();
+        if (raw.find_first_of(".eE") == std::string_view::npos &&
+            !parseError([&] { reader.get_int64(); }))
+          builder.value(reader.get_int64());
+        else
+          builder.value(reader.get_double());
+        break;
+      }
+      case Token::Boolean:
+        builder.value(reader.get_boolean());
+        break;
+      default:
+        CHECK(token == Token::Null);
+        builder.value(nullptr);
+        break;
+      }
+      CHECK(reader.depth() == in_object.size());
+    }
+    CHECK(in_object.empty());
+    CHECK(reader.offset() == doc.size());
+    CHECK(builder.build().to_print() ==
+          smalljson::Parser::parse(doc).to_print());
+
+    // skip() on each container leaves the reader exactly where reading
+    // through it does: on the matching End token.
+    for (size_t target = 0;; target++) {
+      smalljson::JsonReader walker(doc), skipper(doc);
+      size_t begins = 0;
+      bool found = false;
+      while (walker.next()) {
+        skipper.next();
+        if (walker.token() != Token::BeginObject &&
+            walker.token() != Token::BeginArray)
+          continue;
+        if (begins++ != target)
+          continue;
+        found = true;
+        size_t depth = walker.depth();
+        Token end = walker.token() == Token::BeginObject ? Token::EndObject
+                                                         : Token::EndArray;
+        do
+          walker.next();
+        while (walker.token() != end || walker.depth() != depth - 1);
+        skipper.skip();
+        CHECK(readerState(skipper) == readerState(walker));
+        // And reading carries on identically.
+        while (walker.next()) {
+          CHECK(skipper.next());
+          CHECK(readerState(skipper) == readerState(walker));
+        }
+        CHECK(!skipper.next());
+        break;
+      }
+      if (!found)
+        break;
+    }
+  }
+
+  // depth() and key() for nested members.
+  const std::string nested = R"({"a":{"b":[1,{"c":true}]},"d":null})";
+  smalljson::JsonReader reader(nested);
+  const std::vector<std::tuple<Token, std::string, size_t>> expected = {
+      {Token::BeginObject, "", 1}, {Token::BeginObject, "a", 2},
+      {Token::BeginArray, "b", 3}, {Token::Number, "", 3},
+      {Token::BeginObject, "", 4}, {Token::Boolean, "c", 4},
+      {Token::EndObject, "", 3},   {Token::EndArray, "", 2},
+      {Token::EndObject, "", 1},   {Token::Null, "d", 1},
+      {Token::EndObject, "", 0},
+  };
+  std::vector<std::tuple<Token, std::string, size_t>> seen;
+  while (reader.next())
+    seen.emplace_back(reader.token(), std::string(reader.key()),
+                      reader.depth());
+  CHECK(seen == expected);
+  // skip() elsewhere is a no-op.
+  smalljson::JsonReader scalar(nested);
+  scalar.next();
+  scalar.next();
+  scalar.next();
+  scalar.next();
+  CHECK(scalar.token() == Token::Number);
+  auto before = readerState(scalar);
+  scalar.skip();
+  CHECK(readerState(scalar) == before);
+}
+
+struct Test {
+  const char *name;
+  void (*run)();
+};
+
+const Test kTests[] = {
+    {"codegen_escaped_key", testCodegenEscapedKey},
+    {"codegen_odd_keys", testCodegenOddKeys},
+    {"cursor_number_grammar", testCursorNumberGrammar},
+    {"out_of_range_doubles", testOutOfRangeDoubles},
+    {"big_integers", testBigIntegers},
+    {"frozen_literals", testFrozenLiterals},
+    {"ndjson_batch", testNdjsonBatch},
+    {"query_single_pass", testQuerySinglePass},
+    {"run_parts", testRunParts},
+    {"arena_ownership", testArenaOwnership},
+    {"json_stream", testJsonStream},
+    {"parse_options", testParseOptions},
+    {"object_index", testObjectIndex},
+    {"builder", testBuilder},
+    {"writer_matches_builder", testWriterMatchesBuilder},
+    {"json_traits", testJsonTraits},
+    {"error_location", testErrorLocation},
+    {"parse_many", testParseMany},
+    {"parse_keys", testParseKeys},
+    {"value_equality", testValueEquality},
+    {"duplicate_keys", testDuplicateKeys},
+    {"string_storage", testStringStorage},
+    {"key_lookups", testKeyLookups},
+    {"typed_get", testTypedGet},
+    {"walk", testWalk},
+    {"json_reader", testJsonReader},
+};
+} // namespace
+
+int main(int argc, char **argv) {
+  for (const Test &test : kTests) {
+    if (argc > 1 && std::strcmp(argv[1], test.name) != 0)
+      continue;
+    int before = failures;
+    try {
+      test.run();
+    } catch (const std::exception &err) {
+      std::fprintf(stderr, "%s: unexpected exception: %s\n", test.name,
+                   err.what());
+      failures++;
+    }
+    std::printf("%-28s %s\n", test.name, failures == before ? "ok" : "FAILED");
+  }
+  return failures;
+}
@@ -0,0 +1,523 @@
+#include "bench_order_parser.h"
+#include "smalljson.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <thread>
+
+// Micro-benchmarks behind the tuning constants and defaults in smalljson.
+// Run all of them, or the ones named on the command line:
+//
+//   smalljson_bench [--list] [name...]
+//
+// Each case repeats its body for at least kMinTime and reports the best of
+// kRounds rounds, so numbers are comparable between runs on one machine
+// but not across machines. Build Release and keep the machine quiet.
+
+namespace {
+using Clock = std::chrono::steady_clock;
+constexpr auto kMinTime = std::chrono::milliseconds(40);
+constexpr int kRounds = 5;
+
+// Keeps the optimizer from dropping a result.
+template <typename T> void keep(const T &value) {
+  asm volatile("" : : "r"(&value) : "memory");
+}
+
+// Nanoseconds per call of `body`, which performs `ops` operations.
+template <typename Fn> double timeOp(size_t ops, Fn &&body) {
+  double best = 0;
+  for (int round = 0; round < kRounds; round++) {
+    size_t calls = 0;
+    auto start = Clock::now();
+    auto now = start;
+    do {
+      body();
+      calls++;
+      now = Clock::now();
+    } while (now - start < kMinTime);
+    double ns =
+        std::chrono::duration<double, std::nano>(now - start).count() /
+        static_cast<double>(calls * ops);
+    if (round == 0 || ns < best)
+      best = ns;
+  }
+  return best;
+}
+
+std::vector<std::string> makeKeys(size_t count) {
+  std::vector<std::string> keys;
+  keys.reserve(count);
+  for (size_t idx = 0; idx < count; idx++)
+    keys.push_back("field_" + std::to_string(idx));
+  return keys;
+}
+
+// A few hundred lookups of present keys in random order.
+std::vector<std::string> makeProbes(const std::vector<std::string> &keys) {
+  std::mt19937 rng(42);
+  std::vector<std::string> probes;
+  for (size_t idx = 0; idx < 512; idx++)
+    probes.push_back(keys[rng() % keys.size()]);
+  return probes;
+}
+
+// Object::find through the ordered map, a linear scan of a flat vector (what
+// an unindexed small object amounts to), and the Swiss index. The crossover
+// picks Object::kIndexThreshold.
+void benchLookup() {
+  std::printf("%8s %10s %10s %10s   ns/lookup\n", "keys", "map", "flat",
+              "hash");
+  const size_t sizes[] = {4,   6,    8,     12,    16,     24,     32,
+                          48,  64,   256,   1024,  4096,   16384,  65536,
+                          262144, 1048576};
+  for (size_t size : sizes) {
+    std::vector<std::string> keys = makeKeys(size);
+    std::vector<std::string> probes = makeProbes(keys);
+    smalljson::Object::object_t members;
+    std::vector<std::pair<std::string, smalljson::Value>> flat;
+    for (size_t idx = 0; idx < size; idx++) {
+      members.emplace(keys[idx], smalljson::Value(int64_t(idx)));
+      flat.emplace_back(keys[idx], smalljson::Value(int64_t(idx)));
+    }
+    const smalljson::Object tree(smalljson::Object::object_t(members),
+                                 smalljson::HashIndex::Never);
+    const smalljson::Object hashed(std::move(members),
+                                   smalljson::HashIndex::Always);
+    double map_ns = timeOp(probes.size(), [&] {
+      for (const std::string &probe : probes)
+        keep(tree.find(probe));
+    });
+    double hash_ns = timeOp(probes.size(), [&] {
+      for (const std::string &probe : probes)
+        keep(hashed.find(probe));
+    });
+    std::printf("%8zu %10.1f ", size, map_ns);
+    if (size <= 4096) {
+      double flat_ns = timeOp(probes.size(), [&] {
+        for (const std::string &probe : probes) {
+          auto iter = flat.begin();
+          while (iter != flat.end() && iter->first != probe)
+            ++iter;
+          keep(iter);
+        }
+      });
+      std::printf("%10.1f ", flat_ns);
+    } else {
+      std::printf("%10s ", "-");
+    }
+    std::printf("%10.1f\n", hash_ns);
+  }
+}
+
+// One order message per line, with the occasional member the schema does
+// not know.
+std::vector<std::string> makeOrders(size_t count) {
+  std::mt19937 rng(7);
+  std::vector<std::string> orders;
+  for (size_t idx = 0; idx < count; idx++) {
+    std::string order = "{\"id\":" + std::to_string(rng()) +
+                        ",\"symbol\":\"SYM" + std::to_string(rng() % 500) +
+                        "\",\"side\":\"" + (rng() % 2 ? "buy" : "sell") +
+                        "\",\"price\":" + std::to_string(rng() % 100000) +
+                        "." + std::to_string(rng() % 100) +
+                        ",\"quantity\":" + std::to_string(rng() % 1000) +
+                        ",\"filled\":" + (rng() % 2 ? "true" : "false") +
+                        ",\"note\":null";
+    if (idx % 8 == 0)
+      order += ",\"venue\":{\"mic\":\"XNAS\",\"seq\":[1,2,3]}";
+    orders.push_back(order + "}");
+  }
+  return orders;
+}
+
+// A parser generated by smalljson_codegen against Parser::parse followed by
+// reading the same fields out of the tree.
+void benchCodegen() {
+  std::vector<std::string> orders = makeOrders(4096);
+  size_t bytes = 0;
+  for (const std::string &order : orders)
+    bytes += order.size();
+  double generated = timeOp(orders.size(), [&] {
+    for (const std::string &order : orders)
+      keep(Order::parse(order));
+  });
+  double generic = timeOp(orders.size(), [&] {
+    for (const std::string &order : orders) {
+      smalljson::Value root = smalljson::Parser::parse(order);
+      Order out;
+      for (auto &[key, value] : root.to_object()) {
+        if (key == "id")
+          out.id = value.get<int64_t>().value_or(0);
+        else if (key == "symbol")
+          out.symbol = value.to_string();
+        else if (key == "side")
+          out.side = value.to_string();
+        else if (key == "price")
+          out.price = value.to_double();
+        else if (key == "quantity")
+          out.quantity = value.get<int64_t>().value_or(0);
+        else if (key == "filled")
+          out.filled = value.to_boolean();
+        else if (key == "note" && value.isString())
+          out.note = value.to_string();
+        else if (key != "note")
+          out.extra[key.str()] = std::move(value);
+      }
+      keep(out);
+    }
+  });
+  double size = static_cast<double>(bytes) / orders.size();
+  std::printf("%-10s %10s %10s\n", "", "ns/msg", "MB/s");
+  std::printf("%-10s %10.1f %10.1f\n", "generated", generated,
+              size * 1e3 / generated);
+  std::printf("%-10s %10.1f %10.1f\n", "generic", generic,
+              size * 1e3 / generic);
+}
+
+// Request logs as JSON Lines: a filter, a group-by and three metrics, so
+// a scan per field reads each line five times.
+void benchQuery() {
+  std::mt19937 rng(11);
+  const char *services[] = {"api", "auth", "billing", "search"};
+  std::string ndjson;
+  for (size_t idx = 0; idx < 200000; idx++) {
+    ndjson += "{\"ts\":" + std::to_string(1700000000 + idx) +
+              ",\"service\":\"" + services[rng() % 4] +
+              "\",\"status\":" + std::to_string(rng() % 8 ? 200 : 500) +
+              ",\"request\":{\"path\":\"/v1/items/" +
+              std::to_string(rng() % 1000) +
+              "\",\"headers\":{\"accept\":\"*/*\",\"user-agent\":"
+              "\"curl/8.0\"}},\"latency_ms\":" +
+              std::to_string(rng() % 500) +
+              ",\"bytes\":" + std::to_string(rng() % 100000) +
+              ",\"upstream\":{\"latency_ms\":" + std::to_string(rng() % 400) +
+              "}}\n";
+  }
+  smalljson::Query query;
+  query.where("/status", smalljson::Query::Op::Eq, 200)
+      .group_by("/service")
+      .metric("/latency_ms")
+      .metric("/bytes")
+      .metric("/upstream/latency_ms");
+  double lines = 200000;
+  std::printf("%-10s %10s %10s\n", "threads", "ns/line", "MB/s");
+  for (unsigned threads = 1; threads <= std::thread::hardware_concurrency();
+       threads *= 4) {
+    double ns = timeOp(1, [&] { keep(query.run(ndjson, threads)); }) / lines;
+    std::printf("%-10u %10.1f %10.1f\n", threads, ns,
+                ndjson.size() / lines * 1e3 / ns);
+  }
+}
+
+// One flat object of `count` members with string and number values; with
+// `repeat`, every fourth key repeats an earlier one.
+std::string makeObject(size_t count, bool repeat) {
+  std::vector<std::string> keys = makeKeys(count);
+  std::string text = "{";
+  for (size_t idx = 0; idx < count; idx++) {
+    if (idx)
+      text += ',';
+    const std::string &key = repeat && idx % 4 == 3 ? keys[idx / 2] : keys[idx];
+    text += '"' + key + "\":" +
+            (idx % 2 ? "\"value " + std::to_string(idx) + '"'
+                     : std::to_string(idx * 7));
+  }
+  return text + "}";
+}
+
+// Parser::parse under each DuplicateKeys policy, on unique keys and on
+// keys that repeat.
+void benchDuplicateKeys() {
+  using smalljson::DuplicateKeys;
+  std::printf("%8s %8s %10s %10s %10s   ns/member\n", "keys", "repeats",
+              "first", "last", "reject");
+  for (size_t size : {4, 16, 100, 1000, 10000}) {
+    for (bool repeat : {false, true}) {
+      const std::string text = makeObject(size, repeat);
+      std::printf("%8zu %8s", size, repeat ? "yes" : "no");
+      for (DuplicateKeys keys : {DuplicateKeys::FirstWins,
+                                 DuplicateKeys::LastWins,
+                                 DuplicateKeys::Reject}) {
+        if (repeat && keys == DuplicateKeys::Reject) {
+          std::printf(" %10s", "-");
+          continue;
+        }
+        std::printf(" %10.1f", timeOp(size, [&] {
+                      keep(smalljson::Parser::parse(text, keys));
+                    }));
+      }
+      std::printf("\n");
+    }
+  }
+}
+
+// An array of `count` records with nested objects, strings with escapes
+// and numbers: the kind of value parse_keys and skip_value step over.
+std::string makeRecords(size_t count) {
+  std::string text = "[";
+  for (size_t idx = 0; idx < count; idx++) {
+    if (idx)
+      text += ',';
+    text += "{\"seq\":" + std::to_string(idx) +
+            ",\"label\":\"item \\\"" + std::to_string(idx) +
+            "\\\" [x]\",\"tags\":[\"a\",\"b{\",\"c\"],"
+            "\"pos\":{\"x\":" + std::to_string(idx * 0.5) +
+            ",\"y\":-" + std::to_string(idx) + "},\"ok\":true}";
+  }
+  return text + "]";
+}
+
+// The obvious skip: one byte at a time, tracking strings and depth.
+const char *skipBytewise(const char *cur, const char *end) {
+  int depth = 0;
+  bool quoted = false;
+  for (; cur != end; cur++) {
+    if (quoted) {
+      if (*cur == '\\')
+        cur++;
+      else if (*cur == '"')
+        quoted = false;
+    } else if (*cur == '"') {
+      quoted = true;
+    } else if (*cur == '{' || *cur == '[') {
+      depth++;
+    } else if ((*cur == '}' || *cur == ']') && --depth == 0) {
+      return cur + 1;
+    }
+  }
+  return end;
+}
+
+// Parser::parse against parse_keys picking two small members out of a
+// document dominated by a large one, and building a large array against
+// skipping it.
+void benchSkip() {
+  const std::string records = makeRecords(2000);
+  const std::string doc = "{\"id\":42,\"items\":" + records +
+                          ",\"name\":\"bench\",\"more\":" + records + "}";
+  std::printf("%-22s %10s %10s   (%zu KiB document)\n", "", "us", "MB/s",
+              doc.size() >> 10);
+  auto row = [](const char *name, size_t bytes, double ns) {
+    std::printf("%-22s %10.1f %10.1f\n", name, ns / 1e3, bytes * 1e3 / ns);
+  };
+  row("Parser::parse", doc.size(),
+      timeOp(1, [&] { keep(smalljson::Parser::parse(doc)); }));
+  row("Parser::parse_keys", doc.size(), timeOp(1, [&] {
+        keep(smalljson::Parser::parse_keys(doc, {"id", "name"}));
+      }));
+  std::printf("%-22s   (%zu KiB array)\n", "", records.size() >> 10);
+  row("Cursor::read_value", records.size(),
+      timeOp(1, [&] { keep(smalljson::Cursor(records).read_value()); }));
+  row("Cursor::skip_value", records.size(),
+      timeOp(1, [&] { keep(smalljson::Cursor(records).skip_value()); }));
+  row("byte-at-a-time skip", records.size(), timeOp(1, [&] {
+        keep(skipBytewise(records.data(), records.data() + records.size()));
+      }));
+}
+
+// AnonHugePages of this process, in MiB.
+long hugePagesMiB() {
+  std::ifstream smaps("/proc/self/smaps_rollup");
+  for (std::string line; std::getline(smaps, line);) {
+    if (line.rfind("AnonHugePages:", 0) == 0)
+      return std::atol(line.c_str() + 14) >> 10;
+  }
+  return 0;
+}
+
+double msSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+// A Document of SMALLJSON_BENCH_MB (default 64) MiB of records parsed on
+// the heap and into Arenas, then every record visited in random order and
+// the tree destroyed. Single runs: the sizes make best-of-N slow. For
+// transparent huge pages on the heap, rerun with
+// GLIBC_TUNABLES=glibc.malloc.hugetlb=1.
+void benchArena() {
+  const char *env = std::getenv("SMALLJSON_BENCH_MB");
+  size_t target = size_t(env ? std::atol(env) : 64) << 20;
+  std::string records = makeRecords(1000);
+  records.back() = ',';
+  std::string text = "[";
+  while (text.size() < target)
+    text.append(records, 1, std::string::npos);
+  text.back() = ']';
+  std::printf("%-12s %10s %10s %10s %10s   (%zu MiB)\n", "", "parse ms",
+              "walk ms", "free ms", "THP MiB", text.size() >> 20);
+  smalljson::Arena::Options thp, plain, hugetlb;
+  plain.transparent_huge_pages = false;
+  hugetlb.hugetlb = true;
+  const std::pair<const char *, const smalljson::Arena::Options *> modes[] = {
+      {"heap", nullptr},
+      {"arena", &plain},
+      {"arena+thp", &thp},
+      {"arena+tlb", &hugetlb}};
+  for (auto [name, options] : modes) {
+    long huge = hugePagesMiB();
+    auto start = Clock::now();
+    smalljson::Document doc = options
+                                  ? smalljson::Document::parse(text, *options)
+                                  : smalljson::Document::parse(text);
+    double parse = msSince(start);
+    huge = hugePagesMiB() - huge;
+    std::vector<const smalljson::Value *> order;
+    for (const smalljson::Value &record : doc.root().to_array())
+      order.push_back(&record);
+    std::shuffle(order.begin(), order.end(), std::mt19937(3));
+    start = Clock::now();
+    double sum = 0;
+    for (const smalljson::Value *record : order)
+      sum += record->at("pos").at("x").to_double() +
+             record->at("label").to_string().size();
+    keep(sum);
+    double walk = msSince(start);
+    start = Clock::now();
+    doc = smalljson::Document();
+    std::printf("%-12s %10.0f %10.0f %10.0f %10ld\n", name, parse, walk,
+                msSince(start), huge);
+  }
+}
+
+// Whole-tree traversals over a Document of SMALLJSON_BENCH_MB (default
+// 64) MiB of records: to_print, hash, operator== against a copy,
+// memory_usage and walk(). These are the loops SMALLJSON_PREFETCH
+// affects; configure with -DSMALLJSON_PREFETCH=ON and rerun to compare.
+void benchWalk() {
+  const char *env = std::getenv("SMALLJSON_BENCH_MB");
+  size_t target = size_t(env ? std::atol(env) : 64) << 20;
+  std::string records = makeRecords(1000);
+  records.back() = ',';
+  std::string text = "[";
+  while (text.size() < target)
+    text.append(records, 1, std::string::npos);
+  text.back() = ']';
+  smalljson::Value root = smalljson::Parser::parse(text);
+  smalljson::Value copy = root;
+  size_t nodes = 0;
+  smalljson::walk(root, [&](const smalljson::Value &, size_t) { nodes++; });
+  std::printf("%-14s %10s %10s   (%zu MiB, %zu nodes)\n", "", "ms",
+              "ns/node", text.size() >> 20, nodes);
+  auto row = [&](const char *name, auto &&body) {
+    double best = 0;
+    for (int round = 0; round < 3; round++) {
+      auto start = Clock::now();
+      body();
+      double ms = msSince(start);
+      best = round == 0 || ms < best ? ms : best;
+    }
+    std::printf("%-14s %10.1f %10.2f\n", name, best, best * 1e6 / nodes);
+  };
+  std::string out;
+  row("to_print", [&] {
+    out.clear();
+    root.to_print(out);
+    keep(out);
+  });
+  row("hash", [&] { keep(root.hash()); });
+  row("operator==", [&] { keep(root == copy); });
+  row("memory_usage", [&] { keep(root.memory_usage()); });
+  row("walk", [&] {
+    size_t strings = 0;
+    smalljson::walk(root, [&](const smalljson::Value &value, size_t) {
+      strings += value.isString();
+    });
+    keep(strings);
+  });
+}
+
+// A key-heavy corpus: 2000 records of 8 members whose keys and string
+// values all have `len` bytes. Parsing, deep copies and memory per string
+// either side of String::kInlineCapacity.
+void benchStrings() {
+  std::printf("%6s %12s %12s %12s   per key or value\n", "bytes", "parse ns",
+              "copy ns", "heap bytes");
+  for (size_t len : {8, 16, 22, 23, 32, 64}) {
+    std::string text = "[";
+    for (size_t rec = 0; rec < 2000; rec++) {
+      text += rec ? ",{" : "{";
+      for (size_t idx = 0; idx < 8; idx++) {
+        std::string key = "k" + std::to_string(idx) + "_";
+        key.resize(len, 'k');
+        std::string value = std::to_string(rec) + "_";
+        value.resize(len, 'v');
+        text += (idx ? ",\"" : "\"") + key + "\":\"" + value + '"';
+      }
+      text += '}';
+    }
+    text += ']';
+    const size_t strings = 2000 * 8 * 2;
+    smalljson::Value root = smalljson::Parser::parse(text);
+    size_t tree = 0;
+    for (const smalljson::Value &record : root.to_array())
+      tree += record.memory_usage();
+    // Less the map nodes, which do not depend on the string length.
+    smalljson::Value blank = smalljson::Parser::parse(
+        R"({"0":"","1":"","2":"","3":"","4":"","5":"","6":"","7":""})");
+    tree -= 2000 * blank.memory_usage();
+    std::printf("%6zu %12.1f %12.1f %12.1f\n", len,
+                timeOp(strings, [&] { keep(smalljson::Parser::parse(text)); }),
+                timeOp(strings, [&] { keep(smalljson::Value(root)); }),
+                double(tree) / strings);
+  }
+}
+
+struct Bench {
+  const char *name;
+  const char *help;
+  void (*run)();
+};
+
+const Bench kBenches[] = {
+    {"lookup", "Object::find: map vs flat vector vs hash index, 4..1M keys",
+     benchLookup},
+    {"codegen", "Order messages: generated parser vs Parser::parse",
+     benchCodegen},
+    {"query", "Query::run over JSON Lines: filter, group-by, 3 metrics",
+     benchQuery},
+    {"duplicate_keys", "Parser::parse per DuplicateKeys policy, 4..10k keys",
+     benchDuplicateKeys},
+    {"skip", "parse_keys and skip_value against building the values",
+     benchSkip},
+    {"arena", "Document trees on the heap and in Arenas, with huge pages",
+     benchArena},
+    {"walk", "to_print, hash, ==, memory_usage and walk over a large tree",
+     benchWalk},
+    {"strings", "Key-heavy records with 8..64-byte strings: SSO boundary",
+     benchStrings},
+};
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc > 1 && std::strcmp(argv[1], "--list") == 0) {
+    for (const Bench &bench : kBenches)
+      std::printf("%-12s %s\n", bench.name, bench.help);
+    return 0;
+  }
+  for (int idx = 1; idx < argc; idx++) {
+    bool known = false;
+    for (const Bench &bench : kBenches)
+      known |= std::strcmp(argv[idx], bench.name) == 0;
+    if (!known) {
+      std::fprintf(stderr, "unknown benchmark %s, see --list\n", argv[idx]);
+      return 1;
+    }
+  }
+  for (const Bench &bench : kBenches) {
+    bool wanted = argc == 1;
+    for (int idx = 1; idx < argc; idx++)
+      wanted |= std::strcmp(argv[idx], bench.name) == 0;
+    if (!wanted)
+      continue;
+    std::printf("== %s: %s\n", bench.name, bench.help);
+    bench.run();
+    std::printf("\n");
+  }
+  return 0;
+}
@@ -0,0 +1,311 @@
+#include "smalljson.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+
+// smalljson_codegen <schema.json> <output.h> [namespace]
+//
+// Reads a JSON Schema describing an object ("title" names the struct,
+// "properties" lists the fields) and emits a header with a struct and a
+// specialized Struct::parse(). Known keys are dispatched through a perfect
+// hash computed here; unknown keys are parsed by the generic Parser and kept
+// in the struct's `extra` Object.
+
+namespace {
+enum class FieldKind { Integer, Number, String, Boolean, Value };
+
+struct Field {
+  std::string key;
+  std::string member;
+  FieldKind kind;
+  bool nullable;
+};
+
+struct PerfectHash {
+  uint32_t seed;
+  std::vector<int> slots;
+};
+
+std::string readFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    throw std::runtime_error("cannot open " + path);
+  std::ostringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+bool isKeyword(const std::string &name) {
+  static const char *keywords[] = {
+      "auto",   "bool",     "break",  "case",     "char",   "class",
+      "const",  "continue", "default", "delete",  "do",     "double",
+      "else",   "enum",     "extra",  "false",    "float",  "for",
+      "if",     "int",      "long",   "namespace", "new",   "operator",
+      "parse",  "private",  "public", "return",   "short",  "signed",
+      "sizeof", "static",   "struct", "switch",   "template", "this",
+      "true",   "typedef",  "union",  "unsigned", "using",  "virtual",
+      "void",   "while"};
+  for (const char *keyword : keywords) {
+    if (name == keyword)
+      return true;
+  }
+  return false;
+}
+
+std::string toIdentifier(const std::string &name) {
+  std::string ident;
+  for (char ch : name) {
+    ident += std::isalnum(static_cast<unsigned char>(ch)) ? ch : '_';
+  }
+  if (ident.empty() || std::isdigit(static_cast<unsigned char>(ident[0])))
+    ident.insert(ident.begin(), '_');
+  if (isKeyword(ident))
+    ident += '_';
+  return ident;
+}
+
+// Makes the fields' member names distinct. Keys that differ only in
+// characters an identifier cannot hold ("a-b", "a_b"), and keys that come
+// out as a name the struct already uses, get a numeric suffix, in key
+// order.
+void uniqueMembers(std::vector<Field> &fields, const std::string &name) {
+  std::set<std::string> taken = {name, "extra", "parse"};
+  for (auto &field : fields) {
+    std::string base = field.member;
+    for (int idx = 2; !taken.insert(field.member).second; idx++)
+      field.member = base + "_" + std::to_string(idx);
+  }
+}
+
+FieldKind toKind(const std::string &type) {
+  if (type == "integer")
+    return FieldKind::Integer;
+  if (type == "number")
+    return FieldKind::Number;
+  if (type == "string")
+    return FieldKind::String;
+  if (type == "boolean")
+    return FieldKind::Boolean;
+  return FieldKind::Value;
+}
+
+Field toField(const std::string &key, const smalljson::Value &schema) {
+  Field field{key, toIdentifier(key), FieldKind::Value, false};
+  if (!schema.isObject())
+    return field;
+  auto type = schema.to_object().find("type");
+  if (type == schema.to_object().end())
+    return field;
+  if (type->second.isString()) {
+    field.kind = toKind(type->second.to_string());
+  } else if (type->second.isArray()) {
+    std::vector<std::string> types;
+    for (auto &item : type->second.to_array()) {
+      if (item.isString() && item.to_string() == "null")
+        field.nullable = true;
+      else if (item.isString())
+        types.push_back(item.to_string());
+    }
+    if (types.size() == 1)
+      field.kind = toKind(types[0]);
+  }
+  return field;
+}
+
+PerfectHash findPerfectHash(const std::vector<Field> &fields) {
+  size_t size = 1;
+  while (size < fields.size() * 2)
+    size <<= 1;
+  for (;; size <<= 1) {
+    for (uint32_t seed = 0x811c9dc5u, tries = 0; tries < 100000;
+         tries++, seed = seed * 0x01000193u + 1) {
+      std::vector<int> slots(size, -1);
+      bool collision = false;
+      for (size_t idx = 0; idx < fields.size() && !collision; idx++) {
+        int &slot = slots[smalljson::hashKey(fields[idx].key, seed) &
+                          (size - 1)];
+        collision = slot != -1;
+        slot = static_cast<int>(idx);
+      }
+      if (!collision)
+        return PerfectHash{seed, std::move(slots)};
+    }
+  }
+}
+
+// A C++ string literal for str. Control bytes and DEL get escapes of
+// their own, octal ones being at most three digits long, so a following
+// digit cannot extend them as it would a \x escape.
+std::string cppString(const std::string &str) {
+  std::string out = "\"";
+  for (char ch : str) {
+    unsigned char byte = static_cast<unsigned char>(ch);
+    if (ch == '"' || ch == '\\') {
+      out += '\\';
+      out += ch;
+    } else if (ch == '\n') {
+      out += "\\n";
+    } else if (ch == '\t') {
+      out += "\\t";
+    } else if (byte < 0x20 || byte == 0x7f) {
+      char octal[5];
+      std::snprintf(octal, sizeof(octal), "\\%03o", byte);
+      out += octal;
+    } else {
+      out += ch;
+    }
+  }
+  return out + "\"";
+}
+
+const char *memberType(FieldKind kind) {
+  switch (kind) {
+  case FieldKind::Integer:
+    return "int64_t";
+  case FieldKind::Number:
+    return "double";
+  case FieldKind::String:
+    return "std::string";
+  case FieldKind::Boolean:
+    return "bool";
+  default:
+    return "smalljson::Value";
+  }
+}
+
+const char *memberInit(FieldKind kind) {
+  switch (kind) {
+  case FieldKind::Integer:
+  case FieldKind::Number:
+    return " = 0";
+  case FieldKind::Boolean:
+    return " = false";
+  default:
+    return "";
+  }
+}
+
+const char *readCall(FieldKind kind) {
+  switch (kind) {
+  case FieldKind::Integer:
+    return "cur.read_int64()";
+  case FieldKind::Number:
+    return "cur.read_double()";
+  case FieldKind::String:
+    return "cur.read_string()";
+  case FieldKind::Boolean:
+    return "cur.read_boolean()";
+  default:
+    return "cur.read_value()";
+  }
+}
+
+std::string generate(const std::string &name, const std::string &ns,
+                     const std::string &source,
+                     const std::vector<Field> &fields) {
+  PerfectHash hash = findPerfectHash(fields);
+  std::ostringstream out;
+  out << "// Generated by smalljson_codegen from " << source
+      << ". Do not edit.\n"
+      << "#pragma once\n\n#include \"smalljson.h\"\n\n";
+  if (!ns.empty())
+    out << "namespace " << ns << " {\n";
+  out << "struct " << name << " {\n";
+  for (auto &field : fields) {
+    out << "  " << memberType(field.kind) << " " << field.member
+        << memberInit(field.kind) << ";\n";
+  }
+  out << "  smalljson::Object extra;\n\n"
+      << "  static " << name << " parse(const std::string &json_data);\n"
+      << "};\n\n";
+
+  out << "inline " << name << " " << name
+      << "::parse(const std::string &json_data) {\n"
+      << "  using smalljson::Exception;\n"
+      << "  static constexpr uint32_t kSeed = " << hash.seed << "u;\n"
+      << "  static constexpr struct {\n"
+      << "    std::string_view key;\n"
+      << "    int field;\n"
+      << "  } kSlots[" << hash.slots.size() << "] = {\n";
+  for (int slot : hash.slots) {
+    if (slot == -1)
+      out << "      {{}, -1},\n";
+    else if (fields[slot].key.find('\0') != std::string::npos)
+      // The length, as a literal with a NUL inside is cut short otherwise.
+      out << "      {std::string_view(" << cppString(fields[slot].key) << ", "
+          << fields[slot].key.size() << "), " << slot << "},\n";
+    else
+      out << "      {" << cppString(fields[slot].key) << ", " << slot
+          << "},\n";
+  }
+  out << "  };\n"
+      << "  " << name << " out;\n"
+      << "  smalljson::Cursor cur(json_data);\n"
+      << "  cur.expect('{', Exception::ParseError::NOT_JSON);\n"
+      << "  if (!cur.consume('}')) {\n"
+      << "    do {\n"
+      << "      std::string_view key = cur.read_key();\n"
+      << "      std::string unescaped;\n"
+      << "      if (key.find('\\\\') != std::string_view::npos)\n"
+      << "        key = unescaped = cur.unescape(key);\n"
+      << "      cur.expect(':', Exception::ParseError::MISS_COLON);\n"
+      << "      const auto &slot = kSlots[smalljson::hashKey(key, kSeed) & "
+      << hash.slots.size() - 1 << "];\n"
+      << "      switch (slot.key == key ? slot.field : -1) {\n";
+  for (size_t idx = 0; idx < fields.size(); idx++) {
+    const Field &field = fields[idx];
+    out << "      case " << idx << ":\n";
+    if (field.nullable && field.kind != FieldKind::Value)
+      out << "        if (!cur.consume_null())\n  ";
+    out << "        out." << field.member << " = " << readCall(field.kind)
+        << ";\n"
+        << "        break;\n";
+  }
+  out << "      default:\n"
+      << "        out.extra[std::string(key)] = cur.read_value();\n"
+      << "        break;\n"
+      << "      }\n"
+      << "    } while (cur.consume(','));\n"
+      << "    cur.expect('}', Exception::ParseError::LACK_COMMA_OR_BRACE);\n"
+      << "  }\n"
+      << "  cur.finish();\n"
+      << "  return out;\n"
+      << "}\n";
+  if (!ns.empty())
+    out << "} // namespace " << ns << "\n";
+  return out.str();
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    std::cerr << "usage: " << argv[0]
+              << " <schema.json> <output.h> [namespace]\n";
+    return 2;
+  }
+  try {
+    smalljson::Value schema = smalljson::Parser::parse(readFile(argv[1]));
+    const smalljson::Object &root = schema.to_object();
+    auto title = root.find("title");
+    if (title == root.end() || !title->second.isString())
+      throw std::runtime_error("schema needs a string \"title\"");
+    std::vector<Field> fields;
+    auto properties = root.find("properties");
+    if (properties != root.end()) {
+      for (auto &[key, value] : properties->second.to_object())
+        fields.push_back(toField(key.str(), value));
+    }
+    std::string name = toIdentifier(title->second.to_string());
+    uniqueMembers(fields, name);
+    std::ofstream out(argv[2], std::ios::binary);
+    out << generate(name, argc > 3 ? argv[3] : "", argv[1], fields);
+    if (!out)
+      throw std::runtime_error(std::string("cannot write ") + argv[2]);
+  } catch (const std::exception &e) {
+    std::cerr << argv[1] << ": " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,428 @@
+#include "smalljson.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// Fuzz target for the parsers. Built with clang it is a libFuzzer target:
+//
+//   smalljson_fuzz corpus/
+//
+// Otherwise (SMALLJSON_FUZZ_MAIN) it runs each file named on the command
+// line, or stdin, once, which is what AFL expects:
+//
+//   afl-fuzz -i seeds -o findings -- smalljson_fuzz @@
+//
+// Every input is parsed by Parser and by a slow reference parser below;
+// both must accept or reject it and agree on the result, which must also
+// survive a to_print() round trip. The other entry points (Document,
+// JsonReader, JsonStream, parse_keys, parse_many, skipValue, Query) run on
+// the same bytes and must agree on acceptance where their grammars
+// coincide. A disagreement
+// aborts with a description on stderr.
+
+namespace {
+struct Reject {};
+
+// Straightforward recursive descent over the grammar Parser accepts with
+// the default ParseOptions, producing the compact text to_print() gives.
+// Every read is bounds-checked; speed is not a concern.
+class Reference {
+public:
+  explicit Reference(std::string_view text) : text_(text) {}
+
+  std::optional<std::string> parse() {
+    try {
+      skipSpace();
+      if (peek() != '{' && peek() != '[')
+        throw Reject();
+      std::string out = value(0);
+      skipSpace();
+      if (pos_ != text_.size())
+        throw Reject();
+      return out;
+    } catch (const Reject &) {
+      return std::nullopt;
+    }
+  }
+
+private:
+  int peek() const {
+    return pos_ < text_.size() ? static_cast<unsigned char>(text_[pos_]) : -1;
+  }
+  char take() {
+    if (pos_ >= text_.size())
+      throw Reject();
+    return text_[pos_++];
+  }
+  void skipSpace() {
+    while (peek() == ' ' || peek() == '\t' || peek() == '\n' || peek() == '\r')
+      pos_++;
+  }
+  void literal(std::string_view word) {
+    if (text_.substr(pos_, word.size()) != word)
+      throw Reject();
+    pos_ += word.size();
+  }
+
+  std::string value(unsigned depth) {
+    switch (peek()) {
+    case '{':
+      return object(depth + 1);
+    case '[':
+      return array(depth + 1);
+    case '"': {
+      std::string out = "\"";
+      smalljson::detail::appendEscaped(out, string());
+      return out + "\"";
+    }
+    case 't':
+      literal("true");
+      return "true";
+    case 'f':
+      literal("false");
+      return "false";
+    case 'n':
+      literal("null");
+      return "null";
+    default:
+      return number();
+    }
+  }
+
+  std::string object(unsigned depth) {
+    if (depth > smalljson::ParseOptions::max_depth)
+      throw Reject();
+    pos_++;
+    std::map<std::string, std::string> members;
+    skipSpace();
+    if (peek() == '}') {
+      pos_++;
+      return "{}";
+    }
+    while (true) {
+      skipSpace();
+      if (peek() != '"')
+        throw Reject();
+      std::string key = string();
+      skipSpace();
+      if (take() != ':')
+        throw Reject();
+      skipSpace();
+      members[key] = value(depth);
+      skipSpace();
+      char ch = take();
+      if (ch == '}')
+        break;
+      if (ch != ',')
+        throw Reject();
+    }
+    std::string out = "{";
+    for (auto &[key, member] : members) {
+      if (out.size() > 1)
+        out += ',';
+      out += '"';
+      smalljson::detail::appendEscaped(out, key);
+      out += "\":" + member;
+    }
+    return out + "}";
+  }
+
+  std::string array(unsigned depth) {
+    if (depth > smalljson::ParseOptions::max_depth)
+      throw Reject();
+    pos_++;
+    skipSpace();
+    if (peek() == ']') {
+      pos_++;
+      return "[]";
+    }
+    std::string out = "[";
+    while (true) {
+      skipSpace();
+      out += value(depth);
+      skipSpace();
+      char ch = take();
+      if (ch == ']')
+        break;
+      if (ch != ',')
+        throw Reject();
+      out += ',';
+    }
+    return out + "]";
+  }
+
+  uint32_t hex4() {
+    uint32_t code = 0;
+    for (int idx = 0; idx < 4; idx++) {
+      char ch = take();
+      code <<= 4;
+      if (ch >= '0' && ch <= '9')
+        code |= ch - '0';
+      else if (ch >= 'a' && ch <= 'f')
+        code |= ch - 'a' + 10;
+      else if (ch >= 'A' && ch <= 'F')
+        code |= ch - 'A' + 10;
+      else
+        throw Reject();
+    }
+    return code;
+  }
+
+  static void utf8(std::string &out, uint32_t code) {
+    if (code < 0x80) {
+      out += static_cast<char>(code);
+    } else if (code < 0x800) {
+      out += static_cast<char>(0xc0 | (code >> 6));
+      out += static_cast<char>(0x80 | (code & 0x3f));
+    } else if (code < 0x10000) {
+      out += static_cast<char>(0xe0 | (code >> 12));
+      out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (code & 0x3f));
+    } else {
+      out += static_cast<char>(0xf0 | (code >> 18));
+      out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+      out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (code & 0x3f));
+    }
+  }
+
+  // Raw control characters and invalid UTF-8 pass through, as in Parser.
+  // Unpaired surrogates decode to U+FFFD.
+  std::string string() {
+    pos_++;
+    std::string out;
+    while (true) {
+      char ch = take();
+      if (ch == '"')
+        return out;
+      if (ch != '\\') {
+        out += ch;
+        continue;
+      }
+      switch (take()) {
+      case '"':
+        out += '"';
+        break;
+      case '\\':
+        out += '\\';
+        break;
+      case '/':
+        out += '/';
+        break;
+      case 'b':
+        out += '\b';
+        break;
+      case 'f':
+        out += '\f';
+        break;
+      case 'n':
+        out += '\n';
+        break;
+      case 'r':
+        out += '\r';
+        break;
+      case 't':
+        out += '\t';
+        break;
+      case 'u': {
+        uint32_t code = hex4();
+        if (code >= 0xd800 && code <= 0xdbff &&
+            text_.substr(pos_, 2) == "\\u") {
+          size_t save = pos_;
+          pos_ += 2;
+          uint32_t low = hex4();
+          if (low >= 0xdc00 && low <= 0xdfff)
+            code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+          else
+            pos_ = save;
+        }
+        utf8(out, code >= 0xd800 && code <= 0xdfff ? 0xfffd : code);
+        break;
+      }
+      default:
+        throw Reject();
+      }
+    }
+  }
+
+  static bool digit(int ch) { return ch >= '0' && ch <= '9'; }
+
+  std::string number() {
+    size_t first = pos_;
+    if (peek() == '-')
+      pos_++;
+    if (!digit(peek()))
+      throw Reject();
+    if (peek() == '0') {
+      pos_++;
+      if (digit(peek()))
+        throw Reject();
+    }
+    while (digit(peek()))
+      pos_++;
+    size_t int_digits = pos_ - first - (text_[first] == '-');
+    bool integral = true;
+    if (peek() == '.') {
+      integral = false;
+      pos_++;
+      if (!digit(peek()))
+        throw Reject();
+      while (digit(peek()))
+        pos_++;
+    }
+    if (peek() == 'e' || peek() == 'E') {
+      integral = false;
+      pos_++;
+      if (peek() == '+' || peek() == '-')
+        pos_++;
+      if (!digit(peek()))
+        throw Reject();
+      while (digit(peek()))
+        pos_++;
+    }
+    std::string_view text = text_.substr(first, pos_ - first);
+    const char *begin = text.data();
+    const char *end = begin + text.size();
+    int64_t integer = 0;
+    if (integral && int_digits <= 19 &&
+        std::from_chars(begin, end, integer).ec == std::errc())
+      return std::to_string(integer);
+    // strtod saturates out-of-range values to +-HUGE_VAL or +-0.0, as
+    // Parser does.
+    double real = 0;
+    if (std::from_chars(begin, end, real).ec != std::errc())
+      real = std::strtod(std::string(text).c_str(), nullptr);
+    return smalljson::Value(real).to_print();
+  }
+
+  std::string_view text_;
+  size_t pos_ = 0;
+};
+
+[[noreturn]] void fail(const char *what, const std::string &input) {
+  std::cerr << "smalljson_fuzz: " << what << "\ninput (" << input.size()
+            << " bytes): " << input << "\n";
+  std::abort();
+}
+
+// Whether `fn` runs without throwing Exception. Anything else escapes and
+// is reported by the fuzzer as a crash.
+template <typename Fn> bool accepts(Fn &&fn) {
+  try {
+    fn();
+    return true;
+  } catch (const smalljson::Exception &) {
+    return false;
+  }
+}
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  const std::string input(reinterpret_cast<const char *>(data), size);
+
+  std::optional<std::string> parsed;
+  smalljson::Exception::ParseError error{};
+  try {
+    parsed = smalljson::Parser::parse(input).to_print();
+  } catch (const smalljson::Exception &err) {
+    error = err.error();
+    if (err.offset() > input.size())
+      fail("error offset past the input", input);
+    err.locate(input);
+  }
+  std::optional<std::string> expected = Reference(input).parse();
+  if (parsed.has_value() != expected.has_value())
+    fail(parsed ? "Parser accepts what the reference rejects"
+                : "Parser rejects what the reference accepts",
+         input);
+  if (parsed && *parsed != *expected)
+    fail("Parser and the reference disagree on the value", input);
+  if (parsed && smalljson::Parser::parse(*parsed).to_print() != *parsed)
+    fail("to_print() does not round-trip", input);
+
+  if (accepts([&] { smalljson::Document::parse(input); }) != parsed.has_value())
+    fail("Document and Parser disagree on acceptance", input);
+  bool tokenized = accepts([&] {
+    smalljson::JsonReader reader(input);
+    while (reader.next()) {
+    }
+  });
+  if (tokenized != parsed.has_value() &&
+      error != smalljson::Exception::ParseError::TOO_DEEP)
+    fail("JsonReader and Parser disagree on acceptance", input);
+  if (parsed &&
+      !accepts([&] { smalljson::Parser::parse_keys(input, {"a", "b"}); }))
+    fail("parse_keys rejects a valid document", input);
+  std::vector<smalljson::Value> batch;
+  bool batched =
+      accepts([&] { smalljson::Parser::parse_many({input, input}, batch, 1); });
+  if (batched != parsed.has_value() ||
+      (parsed && batch[1].to_print() != *parsed))
+    fail("parse_many and Parser disagree", input);
+  // Two copies back to back are two roots; anything else may stop early
+  // but must not crash.
+  const std::string twice = input + input;
+  smalljson::JsonStream stream(twice);
+  smalljson::Value root;
+  size_t roots = 0;
+  accepts([&] {
+    while (stream.next(root) && parsed && root.to_print() == *parsed)
+      roots++;
+  });
+  if (parsed && (roots != 2 || stream.offset() != twice.size()))
+    fail("JsonStream does not split concatenated documents", input);
+
+  // The raw scanners take pointers, so give them a buffer with nothing
+  // after the last byte for the sanitizer to catch.
+  std::unique_ptr<char[]> exact(new char[size]);
+  std::memcpy(exact.get(), data, size);
+  const char *first = exact.get();
+  const char *last = first + size;
+  auto space = [](char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+  };
+  while (first != last && space(*first))
+    first++;
+  const char *stop = nullptr;
+  accepts([&] { stop = smalljson::detail::skipValue(first, last); });
+  if (parsed) {
+    while (stop && stop != last && space(*stop))
+      stop++;
+    if (stop != last)
+      fail("skipValue does not stop at the end of the document", input);
+  }
+  accepts([&] {
+    smalljson::Query query;
+    query.where("/a", smalljson::Query::Op::Ge, 1)
+        .group_by("/b/0")
+        .metric("/c");
+    query.run(std::string_view(exact.get(), size), 1);
+  });
+  return 0;
+}
+
+#ifdef SMALLJSON_FUZZ_MAIN
+static int runOne(std::istream &in) {
+  std::ostringstream ss;
+  ss << in.rdbuf();
+  std::string data = ss.str();
+  return LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t *>(data.data()),
+                                data.size());
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2)
+    return runOne(std::cin);
+  for (int idx = 1; idx < argc; idx++) {
+    std::ifstream in(argv[idx], std::ios::binary);
+    if (!in) {
+      std::cerr << "cannot open " << argv[idx] << "\n";
+      return 1;
+    }
+    runOne(in);
+  }
+  return 0;
+}
+#endif